@@ -0,0 +1,16 @@
+#AC_SEARCH_ZLIB
+AC_DEFUN([AC_SEARCH_ZLIB],[
+
+AC_ARG_WITH([zlib],
+    AS_HELP_STRING([--without-zlib], [Disable reading of gzip-compressed FK tables]))
+
+AS_IF([test "x$with_zlib" != "xno"], [
+  AC_CHECK_HEADER([zlib.h], [
+    AC_CHECK_LIB([z], [inflateInit2_], [
+      AC_SUBST(APFELGRID_HAVE_ZLIB, ["#define APFELGRID_HAVE_ZLIB 1"])
+      AC_SUBST(ZLIB_LDFLAGS, ["-lz"])
+    ])
+  ])
+])
+
+])
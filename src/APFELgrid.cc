@@ -31,6 +31,11 @@
 
 #include <math.h>
 #include <sys/time.h>
+#include <map>
+#include <fstream>
+#include <cstdio>
+#include <atomic>
+#include <mutex>
 
 namespace NNPDF{
   // FKGenerator constructor/destructor - FKGenerator is a wrapper class that needs very little handling
@@ -46,6 +51,7 @@ namespace NNPDF{
                             double const& fk  // FK Value
                           )
   {
+    APFELGRID_PROFILE_COUNT("FKGenerator::Fill", 1);
     if (fk==0) return;
     if (d >= fNData) throw std::runtime_error("FKGenerator::Fill datapoint " + ToString(d) + "out of bounds.");
     if (ix1 >= fNx) throw std::runtime_error("FKGenerator::Fill xpoint " + ToString(ix1) + " out of bounds.");
@@ -67,6 +73,7 @@ namespace NNPDF{
                           double const& fk  // FK Value
                         )
   {
+    APFELGRID_PROFILE_COUNT("FKGenerator::Fill", 1);
     if (fk==0) return;
     if (d >= fNData) throw std::runtime_error("FKGenerator::Fill datapoint " + ToString(d) + " out of bounds.");
     if (ix >= fNx) throw std::runtime_error("FKGenerator::Fill xpoint " + ToString(ix) + " out of bounds.");
@@ -78,11 +85,100 @@ namespace NNPDF{
     fSigma[iSig] += fk;
     return;
   };
+
+  // Bulk fill of a channel-major contribution block
+  void FKGenerator::FillBlock( int const& d,        // Datapoint index
+                               double const* block  // FK values
+                             )
+  {
+    APFELGRID_PROFILE_COUNT("FKGenerator::FillBlock", 1);
+    if (d >= fNData) throw std::runtime_error("FKGenerator::FillBlock datapoint " + ToString(d) + " out of bounds.");
+    const int nch = fHadronic ? 14*14:14;
+    for (int c=0; c<nch; c++)
+    {
+      const double* src = block + size_t(c)*fTx;
+      const int j = fChannel[c];
+      if (j == -1) // Channel not in table, contributions must vanish
+      {
+        for (int k=0; k<fTx; k++)
+          if (src[k] != 0) throw std::runtime_error("FKGenerator::FillBlock Cannot find FK table point!");
+        continue;
+      }
+
+      double* dst = fSigma + size_t(d)*fDSz + size_t(j)*fTx;
+      for (int k=0; k<fTx; k++)
+        dst[k] += src[k];
+    }
+    return;
+  };
+
+  // Write the accumulated table to a binary checkpoint
+  void FKGenerator::Checkpoint( std::string const& filename, std::string const& shard, int const& next )
+  {
+    AddTag(GRIDINFO, "SHARD", shard);
+    AddTag(GRIDINFO, "CHECKPOINT", next);
+
+    // Write to a temporary file first, such that an interruption leaves the previous checkpoint intact
+    const std::string tmpfile = filename + ".tmp";
+    std::ofstream os(tmpfile.c_str(), std::ios::binary);
+    PrintBinary(os);
+    os.close();
+
+    RemTag(GRIDINFO, "SHARD");
+    RemTag(GRIDINFO, "CHECKPOINT");
+    if (os.fail() || rename(tmpfile.c_str(), filename.c_str()) != 0)
+      throw std::runtime_error("FKGenerator::Checkpoint cannot write checkpoint file: " + filename);
+  };
+
+  // Restore the accumulated table from a checkpoint
+  int FKGenerator::Resume( std::string const& filename, std::string const& shard )
+  {
+    if (!std::ifstream(filename.c_str()).good())
+      return 0;
+
+    const FKTable<double> cp(filename);
+    const int nfl = fHadronic ? 2*fNonZero:fNonZero;
+    if (!cp.HasTag(GRIDINFO, "CHECKPOINT") || !cp.HasTag(GRIDINFO, "SHARD") || cp.GetTag(GRIDINFO, "SHARD") != shard ||
+        cp.GetDataName() != fDataName || cp.GetNData() != fNData || cp.GetNx() != fNx || cp.IsHadronic() != fHadronic ||
+        cp.GetNonZero() != fNonZero || !std::equal(fFlmap, fFlmap + nfl, cp.GetFlmap()) ||
+        !std::equal(fXgrid, fXgrid + fNx, cp.GetXGrid()))
+      throw std::runtime_error("FKGenerator::Resume checkpoint " + filename + " does not match the table being computed");
+
+    for (int d=0; d<fNData; d++)
+    {
+      const double* src = cp.GetSigma() + size_t(d)*cp.GetDSz();
+      std::copy(src, src + size_t(fTx)*fNonZero, fSigma + size_t(d)*fDSz);
+    }
+
+    return cp.GetTag<int>(GRIDINFO, "CHECKPOINT");
+  };
 }
 
 
 namespace APFELgrid{
 
+  // ************************ FK table shards **************************
+
+  // Whether the (datapoint, order) contribution is in the shard
+  bool FKShard::Contains(int const& d, int const& pto) const
+  {
+    if (d < fDmin || (fDmax >= 0 && d >= fDmax))
+      return false;
+    if (fContributions.size() == 0)
+      return true;
+    return std::find(fContributions.begin(), fContributions.end(), std::make_pair(d, pto)) != fContributions.end();
+  }
+
+  // Description of the shard, as "dmin:dmax" followed by any (datapoint, order) contributions as "d.pto"
+  std::string FKShard::Describe() const
+  {
+    std::stringstream desc;
+    desc << fDmin << ":" << fDmax;
+    for (size_t i=0; i<fContributions.size(); i++)
+      desc << " " << fContributions[i].first << "." << fContributions[i].second;
+    return desc.str();
+  }
+
   // ************************ Public utility functions **************************
   // These are available through the APFELgrid header, for use when initialising
   // APFEL kinematics such that they are suitable for the relevant APPLgrid.
@@ -235,35 +331,9 @@ namespace APFELgrid{
     return norm;
   }
 
-  // Allocates the arrays used for evolution factors
-  double*** alloc_evfactor()
-  {
-    const int nxin = APFEL::nIntervals();
-    double*** f = new double**[nxin];
-    for (int i=0; i<nxin; i++)
-    {
-      f[i] = new double*[14];  // These are in EVLN basis (photon!)
-      for (size_t j=0; j<14; j++)
-        f[i][j] = new double[13]; // These are in APPLGRID basis (no photon!)
-    }
-    return f;
-  }
-
-  // Frees evolution factor array f
-  void free_evfactor( double*** f )
-  {
-    const int nxin = APFEL::nIntervals();
-    for (int i=0; i<nxin; i++)
-    {    
-      for (size_t j=0; j<14; j++)
-        delete[] f[i][j];
-      delete[] f[i];
-    }
-    delete[] f;
-  }
-
   // Computes the requested evolution factors, for initial scale Q0, target scale Q1 and output x-value xo.
-  void compute_evfactors( double const& Q0, double const& Q1, double const& xo, double*** fA )
+  // fA is a flat array of nIntervals*14*13 factors, laid out as [x][EVLN flavour (photon!)][APPLGRID flavour (no photon!)]
+  void compute_evfactors( double const& Q0, double const& Q1, double const& xo, double* fA )
   {
     // APFEL parameters
     const int nxin = APFEL::nIntervals();
@@ -272,23 +342,174 @@ namespace APFELgrid{
 
     // Recalculate if not cached
     if ( (Q0diff > 1E-10) || (Q1diff > 1E-10) )
-        APFEL::EvolveAPFEL(Q0,Q1);
+    {
+      APFELGRID_PROFILE_SCOPE("computeFK::EvolveAPFEL");
+      APFEL::EvolveAPFEL(Q0,Q1);
+    }
 
+    APFELGRID_PROFILE_SCOPE("computeFK::ExternalEvolutionOperator");
+    APFELGRID_PROFILE_COUNT("computeFK::ExternalEvolutionOperator", nxin*14*13);
     for (int xi = 0; xi < nxin; xi++)
       for (size_t fi = 0; fi < 14; fi++)
         for(int i=0; i<13; i++)
-          fA[xi][fi][i] = APFEL::ExternalEvolutionOperator(std::string("Ev2Ph"),i-6,fi,xo,xi);
+          fA[(xi*14 + fi)*13 + i] = APFEL::ExternalEvolutionOperator(std::string("Ev2Ph"),i-6,fi,xo,xi);
+  }
+
+  // ************************ Evolution factor cache **************************
+
+  // Maximum size of the evolution factor cache in bytes. A scale bin requiring more
+  // factors than fit is still cached in full.
+  static const size_t EVCACHE_MAXMEM = size_t(512) << 20;
+
+  /**
+   * \class EvolutionCache
+   * \brief Memoises compute_evfactors by (Q, x)
+   *
+   * Factors are held in one flat array of slots, each of nIntervals*14*13 doubles. Slots
+   * are addressed by index, as the array may grow. Once the cache is full, a miss replaces
+   * the least recently used slot that has not been requested in the current scale bin.
+   */
+  class EvolutionCache
+  {
+    public:
+      EvolutionCache(double const& Q0):
+      fQ0(Q0),
+      fSlotSz(size_t(APFEL::nIntervals())*14*13),
+      fMaxSlots(std::max(size_t(1), EVCACHE_MAXMEM/(fSlotSz*sizeof(double)))),
+      fData(),
+      fKeys(),
+      fUsed(),
+      fSlot(),
+      fBin(0),
+      fHits(0),
+      fMisses(0)
+      {}
+
+      void NextBin() { fBin++; } //!< Start a new scale bin, allowing the previous ones to be replaced
+      int Get(double const& Q, double const& x); //!< Return the slot holding the factors for (Q, x)
+
+      const double* GetFactors(int const& slot) const { return &fData[slot*fSlotSz]; } //!< Return the factors in slot
+
+      size_t GetHits()   const { return fHits;   } //!< Return the number of requests served from the cache
+      size_t GetMisses() const { return fMisses; } //!< Return the number of requests computed through APFEL
+
+    private:
+      typedef std::pair<double, double> Key;
+
+      const double fQ0;
+      const size_t fSlotSz;
+      const size_t fMaxSlots;
+
+      std::vector<double> fData;    //!< Factors, [slot][x][14][13]
+      std::vector<Key>    fKeys;    //!< (Q, x) of each slot
+      std::vector<size_t> fUsed;    //!< Last scale bin in which each slot was requested
+      std::map<Key, int>  fSlot;    //!< Slot of each (Q, x)
+
+      size_t fBin;
+      size_t fHits;
+      size_t fMisses;
+  };
+
+  int EvolutionCache::Get(double const& Q, double const& x)
+  {
+    const Key key(Q, x);
+    std::map<Key, int>::const_iterator iSlot = fSlot.find(key);
+    if (iSlot != fSlot.end())
+    {
+      fHits++;
+      fUsed[iSlot->second] = fBin;
+      return iSlot->second;
+    }
+
+    // Pick a slot, growing the cache if it is not full or if all slots are in use
+    int slot = fKeys.size();
+    if (fKeys.size() >= fMaxSlots)
+      for (size_t i=0; i<fKeys.size(); i++)
+        if (fUsed[i] < fBin && (slot == (int) fKeys.size() || fUsed[i] < fUsed[slot]))
+          slot = i;
+
+    if (slot == (int) fKeys.size())
+    {
+      fData.resize(fData.size() + fSlotSz);
+      fKeys.push_back(key);
+      fUsed.push_back(fBin);
+    }
+    else
+    {
+      fSlot.erase(fKeys[slot]);
+      fKeys[slot] = key;
+      fUsed[slot] = fBin;
+    }
+
+    fMisses++;
+    fSlot[key] = slot;
+    compute_evfactors(fQ0, Q, x, &fData[slot*fSlotSz]);
+    return slot;
+  }
+
+  // Extracts the coupling matrices of the APPLgrid PDF generator genpdf, C[p][m][n] such that subprocess p
+  // evaluates to sum_{m,n} fA[m] C[p][m][n] fB[n] for APPLGRID basis (13 flavour) inputs fA and fB.
+  // appl_pdf::evaluate is bilinear, so the matrices are obtained by evaluating pairs of unit vectors.
+  std::vector<double> get_appl_coupling( appl::appl_pdf* genpdf, size_t const& nsubproc )
+  {
+    std::vector<double> C(nsubproc*13*13), H(nsubproc);
+    double eA[13], eB[13];
+    for (int m=0; m<13; m++)
+      for (int n=0; n<13; n++)
+      {
+        std::fill(eA, eA+13, 0.0); eA[m] = 1;
+        std::fill(eB, eB+13, 0.0); eB[n] = 1;
+        genpdf->evaluate(eA, eB, &H[0]);
+        for (size_t ip=0; ip<nsubproc; ip++)
+          C[(ip*13 + m)*13 + n] = H[ip];
+      }
+    APFELGRID_PROFILE_COUNT("computeFK::GenpdfEvaluate", 13*13 + 1);
+
+    // Verify the coupling matrices on a generic input
+    for (int m=0; m<13; m++)
+    {
+      eA[m] = 1.0/(m+2);
+      eB[m] = 1.0/(15-m);
+    }
+    genpdf->evaluate(eA, eB, &H[0]);
+    for (size_t ip=0; ip<nsubproc; ip++)
+    {
+      double Hc = 0, scale = 0;
+      for (int m=0; m<13; m++)
+        for (int n=0; n<13; n++)
+        {
+          Hc += eA[m]*C[(ip*13 + m)*13 + n]*eB[n];
+          scale += fabs(eA[m]*C[(ip*13 + m)*13 + n]*eB[n]);
+        }
+      if (fabs(Hc - H[ip]) > 1E-10*std::max(scale, fabs(H[ip])))
+        throw std::runtime_error("get_appl_coupling APPLgrid PDF generator is not bilinear");
+    }
+    return C;
+  }
+
+  // Ensures the aligned buffer buf, of capacity cap, holds at least n elements
+  void reserve_buffer( double*& buf, size_t& cap, size_t const& n )
+  {
+    if (n <= cap) return;
+    free(buf); buf = NULL; cap = 0;
+    buf = NNPDF::alignedAlloc<double>(n);
+    cap = n;
   }
 
   // ***************************** Progress Monitoring *************************************
 
-  // Counts the number of nonzero elements that have to be combined to produce an FK table.
-  int countElements(appl::grid const& g)
+  // Counts the number of nonzero elements that have to be combined to produce the shard of an FK table,
+  // from the (datapoint, order) contribution first onwards.
+  int countElements(appl::grid const& g, FKShard const& shard, int const& first)
   {
     int nElm = 0; // Element counter
-    for (int d=0; d<g.Nobs(); d++)
-      for (size_t pto=0; pto < get_ptord(g); pto++)
+    const int npto = get_ptord(g);
+    for (int d=shard.GetDmin(); d<shard.GetDmax(g.Nobs()); d++)
+      for (int pto=0; pto < npto; pto++)
       {
+        if ((d - shard.GetDmin())*npto + pto < first || !shard.Contains(d, pto))
+          continue;
+
         const int gidx = get_grid_idx(g, pto);            // APPLgrid grid index
         appl::igrid const *igrid = g.weightgrid(gidx, d); // APPLgrid igrid pointer
         const size_t nsubproc = g.subProcesses(gidx);     // Number of subprocesses
@@ -303,41 +524,49 @@ namespace APFELgrid{
     return nElm;
   }
 
-  // Print a status update to screen
-  void statusUpdate(timeval const& t1, int const& totElements, int& compElements)
+  // Print a status update to screen. Thread-safe, nElements is the number of newly computed elements.
+  // Updates are printed at most every half second, by whichever thread is not blocked by another's print.
+  void statusUpdate(timeval const& t1, long const& totElements, std::atomic<long>& compElements, long const& nElements)
   {
-    compElements++;    // Increment computed elements
-    const int interval = compElements< 100 ? 5:10;
-    if (compElements % interval == 0)
-    {
-      // Elapsed time update
-      timeval t2; gettimeofday(&t2, NULL);
-      double elapsedTime = (t2.tv_sec - t1.tv_sec); 
-      elapsedTime += (t2.tv_usec - t1.tv_usec) / 1E6f; 
-
-      // Percentage complete, ETA
-      const double percomp= 100.0*((double)compElements/(double)totElements);
-      const double eta = ( elapsedTime / percomp ) * ( 100.0 - percomp );
-
-      std::cout << "-- "<< std::setw(6) << std::setprecision(4)  << percomp << "\% complete."
-           << " T Elapsed: "  << std::setw(6)<<std::setprecision(4) << elapsedTime/60.0 
-           << " min. ETA: "   << std::setw(6)<<std::setprecision(4) << eta/60.0<<" min.\r";
-      std::cout.flush();
-    }
+    static std::mutex lock;
+    static timeval tp = {0, 0};
+    const long comp = (compElements += nElements); // Increment computed elements
+
+    std::unique_lock<std::mutex> guard(lock, std::try_to_lock);
+    if (!guard.owns_lock())
+      return;
+
+    timeval t2; gettimeofday(&t2, NULL);
+    if (comp < totElements && (t2.tv_sec - tp.tv_sec) + (t2.tv_usec - tp.tv_usec)/1E6 < 0.5)
+      return;
+    tp = t2;
+
+    // Elapsed time update
+    double elapsedTime = (t2.tv_sec - t1.tv_sec); 
+    elapsedTime += (t2.tv_usec - t1.tv_usec) / 1E6f; 
+
+    // Percentage complete, ETA
+    const double percomp= 100.0*((double)comp/(double)totElements);
+    const double eta = ( elapsedTime / percomp ) * ( 100.0 - percomp );
+
+    std::cout << "-- "<< std::setw(6) << std::setprecision(4)  << percomp << "\% complete."
+         << " T Elapsed: "  << std::setw(6)<<std::setprecision(4) << elapsedTime/60.0 
+         << " min. ETA: "   << std::setw(6)<<std::setprecision(4) << eta/60.0<<" min.\r";
+    std::cout.flush();
   }
 
   // ************************ FK Table computation **************************
   // These functions provide the tools to initialise and generate FK tables.
 
-  // Generates a new FKGenerator class, given a base appl::grid, initial scale and setname.
+  // Generates a new FKGenerator class, given a base appl::grid, initial scale, setname and number of datapoints.
   // Physics and interpolation parameters are obtained directly from APFEL
-  NNPDF::FKGenerator* generate_FK( appl::grid const& g, double const& Q0, std::string const& setname)
+  NNPDF::FKGenerator* generate_FK( appl::grid const& g, double const& Q0, std::string const& setname, int const& ndata)
   {
     // Generate FKTable header
     NNPDF::FKHeader FKhead;
     FKhead.AddTag(NNPDF::FKHeader::BLOB, "GridDesc", g.getDocumentation());
     FKhead.AddTag(NNPDF::FKHeader::GRIDINFO, "SETNAME", setname);
-    FKhead.AddTag(NNPDF::FKHeader::GRIDINFO, "NDATA", g.Nobs());
+    FKhead.AddTag(NNPDF::FKHeader::GRIDINFO, "NDATA", ndata);
     FKhead.AddTag(NNPDF::FKHeader::GRIDINFO, "HADRONIC", true);
     FKhead.AddTag(NNPDF::FKHeader::VERSIONS, "APFEL", APFEL::GetVersion());
     FKhead.AddTag(NNPDF::FKHeader::THEORYINFO, "Q0", Q0 );
@@ -368,8 +597,26 @@ namespace APFELgrid{
   // by APFEL, resulting in a new FK table. Required arguments are the initial scale Q0, name of the produced table 'name', 
   // the appl::grid g, the path to the appl::grid file itself, and an (optional) appl::grid directory. The paths are required
   // as we have to reconstruct the _m_reweight parameter from APPLgrid.  
-  NNPDF::FKTable<double>* computeFK( double const& Q0, std::string const& name, appl::grid const& g, std::string const& gridfile, std::string directory)
+  //
+  // The combination is performed one scale bin at a time in two phases. First the nonzero weights of the bin and
+  // the evolution factors they require are collected serially, as neither APFEL nor APPLgrid are thread-safe.
+  // Evolution factors are memoised by (Q, x), such that they are shared between x1 and x2, orders and datapoints.
+  // Secondly the weights are contracted with the evolution factors. With the subprocesses written as coupling matrices
+  // C_p, the contribution of a bin to the FK element (k, l, i, j) is
+  //
+  //   sum_{a,b} sum_{m,n} fA_a[i][k][m] ( sum_p w_abp C_p[m][n] ) fB_b[j][l][n]
+  //
+  // which is evaluated as two matrix products by the cache-blocked NNPDF::convoluteMulti, with the fixed
+  // FK_GENERATION_KERNEL such that the table does not depend upon the host CPU.
+  // Each FK element is computed by a single thread, such that the table does not depend upon the number of threads.
+  //
+  // Contributions (d, pto) of a shard are accumulated in turn onto the table, and a checkpoint records the
+  // table after the last complete contribution, such that sharded and resumed tables are identical to full ones.
+  NNPDF::FKTable<double>* computeFK( double const& Q0, std::string const& name, appl::grid const& g, std::string const& gridfile, std::string directory,
+                                     FKShard const& shard, std::string const& checkpoint, double const& interval )
   {
+    APFELGRID_PROFILE_SCOPE("computeFK");
+
     // Read TFile for extraction of pdfwgt parameter
     TFile f(gridfile.c_str());
 
@@ -384,29 +631,68 @@ namespace APFELgrid{
     APFEL::SetFastEvolution(false);
     APFEL::EnableEvolutionOperator(true);
     APFEL::InitializeAPFEL();
-    APFEL::EvolveAPFEL(Q0, Q0);
+    {
+      APFELGRID_PROFILE_SCOPE("computeFK::EvolveAPFEL");
+      APFEL::EvolveAPFEL(Q0, Q0);
+    }
+
+    // Datapoints of the shard, and perturbative orders
+    const int dmin = shard.GetDmin();
+    const int dmax = shard.GetDmax(g.Nobs());
+    const int npto = get_ptord(g);
+    if (dmin < 0 || dmax > g.Nobs() || dmin >= dmax)
+      throw std::runtime_error("computeFK invalid shard datapoint range: " + shard.Describe());
+    APFELGRID_PROFILE_COUNT("computeFK::Datapoints", dmax - dmin);
 
-    // Setup FK table and evolution factor arrays
-    NNPDF::FKGenerator* FK = generate_FK(g, Q0, name);
-    double*** fA = alloc_evfactor();
-    double*** fB = alloc_evfactor();
+    // Setup FK table, contribution block and evolution factor cache
+    NNPDF::FKGenerator* FK = generate_FK(g, Q0, name, dmax - dmin);
+    const int nxin = APFEL::nIntervals();
+    std::vector<double> block(14*14*FK->GetTx());
+    EvolutionCache evcache(Q0);
+
+    // Nonzero (a, b) weights of the current scale bin
+    std::vector<int> slotA, slotB;      // Evolution factor cache slots of each x1 and x2 bin
+    std::vector<int> itemA, itemB;      // Indices in slotA and slotB
+    std::vector<double> itemW;          // Normalised subprocess weights, [item][subprocess]
+
+    // Contraction buffers, with rows r = (k, i) for x1 and c = (l, j) for x2
+    const NNPDF::FKKernel<double>& kernel = *NNPDF::FindKernel<double>(FK_GENERATION_KERNEL);
+    const int R = 14*nxin;
+    double *FA = NULL, *FB = NULL, *M = NULL, *Z = NULL, *OUT = NULL;
+    size_t FAsz = 0, FBsz = 0, Msz = 0, Zsz = 0, OUTsz = 0;
+    reserve_buffer(OUT, OUTsz, size_t(R)*R);
   
+    // Resume from a previous checkpoint
+    const int first = checkpoint.empty() ? 0:FK->Resume(checkpoint, shard.Describe());
+
     // Progress monitoring
-    int completedElements = 0;
-    const int totalElements = countElements(g);
+    std::atomic<long> completedElements(0);
+    const long totalElements = countElements(g, shard, first);
     timeval t1; gettimeofday(&t1, NULL);
+    timeval tc = t1; // Last checkpoint
 
-    for (int d=0; d<g.Nobs(); d++)
-    for (size_t pto=0; pto < get_ptord(g); pto++)
+    for (int d=dmin; d<dmax; d++)
+    for (int pto=0; pto < npto; pto++)
     {
+      // Skip contributions outside of the shard, or already present in the checkpoint
+      const int contribution = (d - dmin)*npto + pto;
+      if (contribution < first || !shard.Contains(d, pto))
+        continue;
+
+      // Time per datapoint and order
+      APFELGRID_PROFILE_SCOPE("computeFK::Contribution");
+
       const int gidx = get_grid_idx(g, pto);          // APPLgrid grid index
       appl::appl_pdf *genpdf = get_appl_pdf(g, gidx); // APPLgrid pdf generator
       const bool pdfwgt = get_pdf_wgt(f, directory, gidx, d);    // APPLgrid pdf weight parameter
 
-      // Define subprocess weight array W, and parton density array H
+      // Define subprocess weight array W, and subprocess coupling matrices C
       const size_t nsubproc = g.subProcesses(gidx);
-      double *W = new double[nsubproc];
-      double *H = new double[nsubproc];
+      std::vector<double> W(nsubproc);
+      const std::vector<double> C = get_appl_coupling(genpdf, nsubproc);
+
+      // Contribution block of this datapoint and order, [14][14][nx][nx]
+      std::fill(block.begin(), block.end(), 0.0);
       
       // Fetch grid pointer
       appl::igrid const *igrid = g.weightgrid(gidx, d);
@@ -415,17 +701,22 @@ namespace APFELgrid{
         const double Q   = sqrt( igrid->fQ2( igrid->gettau(t)) );
         const double as  = APFEL::AlphaQCD(Q);
 
+        // Phase one: collect nonzero weights and evolution factors
+        long nElements = 0;
+        std::vector<int> iB(igrid->Ny2(), -1);
+        slotA.clear(); slotB.clear();
+        itemA.clear(); itemB.clear(); itemW.clear();
+        evcache.NextBin();
+
         for (int a=0; a<igrid->Ny1(); a++  ) // Loop over x1 bins
         {
           // Get trimmed limits
           int nxlow, nxhigh;
           get_igrid_limits(igrid, nsubproc, t, a, nxlow, nxhigh);
+          nElements += std::max(0, nxhigh - nxlow + 1);
 
-          // Compute evolution factors for first PDF, only if there are nonzero weights
           const double x1 = igrid->fx(igrid->gety1(a));
-          if (nxlow <= nxhigh)
-            compute_evfactors(Q0, Q, x1, fA);
-          
+          int iA = -1; // Evolution factors for first PDF
           for (int b=nxlow; b<=nxhigh; b++) // Loop over x2 bins
           {
             // fetch weight values
@@ -434,46 +725,125 @@ namespace APFELgrid{
               if (( W[ip] = (*(const SparseMatrix3d*) const_cast<appl::igrid*>(igrid)->weightgrid(ip))(t,a,b) )!=0)
                 nonzero=true;
             
-            // If nonzero, perform combination
-            if (nonzero)
+            if (!nonzero)
+              continue;
+
+            // Calculate normalisation factor
+            const double x2 = igrid->fx(igrid->gety2(b));
+            const double pdfnrm =  pdfwgt ? igrid->weightfun(x1)*igrid->weightfun(x2) : 1.0;
+            const double norm = pdfnrm*compute_wgt_norm(g, d, pto, as, x1, x2);
+
+            // Fetch evolution factors for first and second PDF
+            if (iA < 0)
+            {
+              iA = slotA.size();
+              slotA.push_back(evcache.Get(Q, x1));
+            }
+            if (iB[b] < 0)
             {
-              // Calculate normalisation factor
-              const double x2 = igrid->fx(igrid->gety2(b));
-              const double pdfnrm =  pdfwgt ? igrid->weightfun(x1)*igrid->weightfun(x2) : 1.0;
-              const double norm = pdfnrm*compute_wgt_norm(g, d, pto, as, x1, x2);
-              
-              // Compute evolution factors for second PDF
-              compute_evfactors(Q0, Q, x2, fB);
-
-              const size_t nxin = APFEL::nIntervals();
-              for (size_t i=0; i<nxin; i++) // Loop over input pdf x1
-              for (size_t j=0; j<nxin; j++) // Loop over input pdf x2
-              for (size_t k=0; k<14; k++) // loop over flavour 1
-              for (size_t l=0; l<14; l++) // loop over flavour 2
-                {
-                  // Rotate to subprocess basis and fill
-                  genpdf->evaluate(fA[i][k],fB[j][l],H);
-                  for (size_t ip=0; ip<nsubproc; ip++)
-                    if (W[ip] != 0 and H[ip] != 0)
-                      FK->Fill( d, i, j, k, l, norm*W[ip]*H[ip] );
-                }
+              iB[b] = slotB.size();
+              slotB.push_back(evcache.Get(Q, x2));
             }
-            statusUpdate(t1, totalElements, completedElements); // Update progress
+            itemA.push_back(iA);
+            itemB.push_back(iB[b]);
+            for (size_t ip=0; ip<nsubproc; ip++)
+              itemW.push_back(norm*W[ip]);
+          }
+        }
+
+        // Phase two: contraction
+        APFELGRID_PROFILE_COUNT_NAMED("computeFK::Weights_pto" + NNPDF::ToString(pto), itemA.size());
+        const int nA = slotA.size(), nB = slotB.size();
+        if (nA > 0)
+        {
+          APFELGRID_PROFILE_SCOPE("computeFK::Contraction");
+          // Contracted dimensions (s, m) and (u, n), padded to the kernel alignment
+          const int KA = 13*nA, KAp = ((KA + kernel.align - 1)/kernel.align)*kernel.align;
+          const int KB = 13*nB, KBp = ((KB + kernel.align - 1)/kernel.align)*kernel.align;
+          reserve_buffer(FA, FAsz, size_t(R)*KAp);
+          reserve_buffer(FB, FBsz, size_t(R)*KBp);
+          reserve_buffer(M,  Msz,  size_t(KA)*KBp);
+          reserve_buffer(Z,  Zsz,  size_t(R)*KAp);
+
+          // Evolution factors, FA[r][(s, m)] and FB[c][(u, n)]
+          std::fill(FA, FA + size_t(R)*KAp, 0.0);
+          std::fill(FB, FB + size_t(R)*KBp, 0.0);
+          for (int s=0; s<nA; s++)
+          {
+            const double* fa = evcache.GetFactors(slotA[s]);
+            for (int i=0; i<nxin; i++)
+              for (int k=0; k<14; k++)
+                std::copy(fa + (i*14 + k)*13, fa + (i*14 + k + 1)*13, FA + size_t(k*nxin + i)*KAp + s*13);
           }
+          for (int u=0; u<nB; u++)
+          {
+            const double* fb = evcache.GetFactors(slotB[u]);
+            for (int j=0; j<nxin; j++)
+              for (int l=0; l<14; l++)
+                std::copy(fb + (j*14 + l)*13, fb + (j*14 + l + 1)*13, FB + size_t(l*nxin + j)*KBp + u*13);
+          }
+
+          // Weighted coupling matrices, M[(s, m)][(u, n)] = sum_p w_sup C_p[m][n]
+          std::fill(M, M + size_t(KA)*KBp, 0.0);
+          for (size_t it=0; it<itemA.size(); it++)
+          {
+            const double* w = &itemW[it*nsubproc];
+            double* Msu = M + size_t(itemA[it]*13)*KBp + itemB[it]*13;
+            for (size_t ip=0; ip<nsubproc; ip++)
+              if (w[ip] != 0)
+                for (int m=0; m<13; m++)
+                  for (int n=0; n<13; n++)
+                    Msu[m*KBp + n] += w[ip]*C[(ip*13 + m)*13 + n];
+          }
+
+          // Z[c][(s, m)] = FB[c] . M[(s, m)], then OUT[r][c] = FA[r] . Z[c]
+          // Both products are distributed over blocks of their R output rows, as there are
+          // few distinct x-points (and so few columns) per datapoint.
+          std::fill(Z, Z + size_t(R)*KAp, 0.0);
+          NNPDF::convoluteMulti(kernel, FB, R, M, KA, KBp, Z, KAp);
+          NNPDF::convoluteMulti(kernel, FA, R, Z, R, KAp, OUT, R);
+
+          // Accumulate into the contribution block
+#if APFELGRID_HAVE_OMP == 1
+          #pragma omp parallel for
+#endif
+          for (int k=0; k<14; k++)
+            for (int i=0; i<nxin; i++)
+              for (int l=0; l<14; l++)
+              {
+                const double* out = OUT + size_t(k*nxin + i)*R + l*nxin;
+                double* fk = &block[((k*14 + l)*nxin + i)*nxin];
+                for (int j=0; j<nxin; j++)
+                  fk[j] += out[j];
+              }
         }
+        statusUpdate(t1, totalElements, completedElements, nElements); // Update progress
+      }
+
+      // Fill the table with the contributions of this datapoint and order
+      FK->FillBlock(d - dmin, &block[0]);
+
+      // Periodic checkpoint
+      timeval tn; gettimeofday(&tn, NULL);
+      if (!checkpoint.empty() && (tn.tv_sec - tc.tv_sec) + (tn.tv_usec - tc.tv_usec)/1E6 >= interval)
+      {
+        FK->Checkpoint(checkpoint, shard.Describe(), contribution + 1);
+        tc = tn;
       }
-      // Free subprocess arrays
-      delete[] W;
-      delete[] H;
     }
 
-    // Cleanup evolution factors
-    free_evfactor(fA);
-    free_evfactor(fB);
+    // Cleanup contraction buffers
+    free(FA); free(FB); free(M); free(Z); free(OUT);
+
+    // The table is complete
+    if (!checkpoint.empty())
+      std::remove(checkpoint.c_str());
 
     std::cout << std::endl;  
+    APFELGRID_PROFILE_COUNT("computeFK::EvolutionCacheHits", evcache.GetHits());
+    APFELGRID_PROFILE_COUNT("computeFK::EvolutionCacheMisses", evcache.GetMisses());
     return FK;
   }
 
 
-}
\ No newline at end of file
+}
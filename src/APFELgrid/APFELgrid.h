@@ -21,6 +21,8 @@
 // SOFTWARE.
 
 #include <string>
+#include <vector>
+#include <utility>
 #include "fastkernel.h"
 
 // Forward decls
@@ -41,11 +43,50 @@ namespace APFELgrid
   void get_appl_Q2lims(appl::grid const& g, double& Q2min, double& Q2max);
 
   // ************************ FK table computation **************************
+
+  // Convolution kernel used in the computation of FK tables. The scalar kernel sums in the same order
+  // on every CPU, whereas the SIMD kernels sum in an order which depends upon their width.
+  static const char* const FK_GENERATION_KERNEL = "scalar";
+
+  /**
+  * \class FKShard
+  * \brief Subset of an FK table to be computed by computeFK
+  *
+  * A shard selects a range of datapoints [dmin, dmax) and, optionally, a set of (datapoint, order)
+  * contributions. The partial table holds the datapoints of the range only, such that range shards
+  * are merged by concatenation (NNPDF::FK_CONCATENATE). Shards split by contribution are merged by
+  * summation (NNPDF::FK_SUM), which rebuilds the full table exactly when summed in order of increasing
+  * perturbative order.
+  */
+  class FKShard
+  {
+    public:
+      FKShard(): fDmin(0), fDmax(-1), fContributions() {}                        //!< Full table
+      FKShard(int const& dmin, int const& dmax): fDmin(dmin), fDmax(dmax), fContributions() {} //!< Datapoints [dmin, dmax)
+
+      void Add(int const& d, int const& pto) { fContributions.push_back(std::make_pair(d, pto)); } //!< Restrict to listed contributions
+
+      bool Contains(int const& d, int const& pto) const; //!< Whether the (datapoint, order) contribution is in the shard
+      int GetDmin() const { return fDmin; }                                      //!< Return the first datapoint
+      int GetDmax(int const& ndata) const { return fDmax < 0 ? ndata:fDmax; }    //!< Return the datapoint range end, for ndata datapoints
+      std::string Describe() const; //!< Return a description of the shard, recorded in checkpoints
+
+    private:
+      int fDmin, fDmax;
+      std::vector< std::pair<int, int> > fContributions;
+  };
+
   // Performs the combination of an APPLgrid g with evolution factors provided
   // by APFEL, resulting in a new FK table. Required arguments are the initial 
   // scale for the FK tables (Q0), the name of the produced table (name), the appl::grid (g),
   // the path to the appl::grid (gridfile) and an optional appl::grid directory (directory).
-  NNPDF::FKTable<double>* computeFK( double const& Q0, std::string const& name, appl::grid const& g, std::string const& gridfile, std::string directory = "grid" );
+  // Optionally only the subset of the table specified by shard is computed. If a checkpoint file is
+  // given, the accumulated table is saved to it at most every interval seconds, and a computation
+  // interrupted after a checkpoint resumes from it. The checkpoint is removed once the table is complete.
+  // The table is computed with the FK_GENERATION_KERNEL convolution kernel whatever the host CPU, such that
+  // it is reproduced bit for bit, by the same build of APFELgrid, on any host.
+  NNPDF::FKTable<double>* computeFK( double const& Q0, std::string const& name, appl::grid const& g, std::string const& gridfile, std::string directory = "grid",
+                                     FKShard const& shard = FKShard(), std::string const& checkpoint = "", double const& interval = 600 );
 }
 
 namespace NNPDF
@@ -80,5 +121,20 @@ namespace NNPDF
                     size_t const& ifl,   // flavour index
                     double const& isig  // FK Value
                   );
+
+        // Bulk fill of a dense contribution block for datapoint d. The block is laid out
+        // channel-major, [14][14][nx][nx] for hadronic and [14][nx] for DIS tables, such
+        // that each flavour channel is added to the table as one contiguous segment.
+        void FillBlock( int const& d,         // Datapoint index
+                        double const* block   // FK values
+                      );
+
+        // Write the accumulated table to a binary checkpoint file, recording the shard
+        // and the index of the next (datapoint, order) contribution to be computed
+        void Checkpoint( std::string const& filename, std::string const& shard, int const& next );
+
+        // Restore the accumulated table from a checkpoint file of the same table and shard,
+        // returning the next contribution to be computed, or zero if there is no checkpoint
+        int Resume( std::string const& filename, std::string const& shard );
     };
 }
\ No newline at end of file
@@ -0,0 +1,305 @@
+// The MIT License (MIT)
+
+// Copyright (c) Stefano Carrazza, Luigi Del Debbio, Nathan Hartland
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include "fastkernel.h"
+
+namespace NNPDF
+{
+ /**
+  * \class FKBundle
+  * \brief K theory variations of one dataset, convoluted with a single PDF luminosity
+  *
+  * Variations (e.g. scale choices) share the x-grid, initial scale and datapoints, but not
+  * necessarily the flavour map: the bundle holds the union of the active channels, with
+  * zeros for the channels absent from a variation. The rows of the K variations of each
+  * datapoint are interleaved in one allocation, [datapoint][variation][channel][x], such
+  * that the PDF luminosity is cached once and each tile of it is applied to all K rows
+  * from cache. Convolution output is laid out as [datapoint][variation][replica].
+  */
+  template<typename T>
+  class FKBundle
+  {
+    public:
+      typedef typename FKTable<T>::extern_pdf extern_pdf;
+      typedef typename FKTable<T>::batch_pdf  batch_pdf;
+
+      FKBundle(std::vector<std::string> const& filenames,
+               std::vector<std::vector<std::string> > const& cFactors = std::vector<std::vector<std::string> >()); //!< Load the variations from file
+      FKBundle(std::vector<const FKTable<T>*> const& tables); //!< Copy the variations from tables
+      ~FKBundle();
+
+      // Convolute all variations, out is [GetNData()][GetNVariations()][NPDF]
+      void Convolute(extern_pdf pdf, size_t const& NPDF, T* out);
+      void Convolute(extern_pdf pdf, size_t const& NPDF, T* out, ConvolutionWorkspace<T>& ws); //!< Convolution reusing a workspace
+      void Convolute(batch_pdf const& pdf, size_t const& NPDF, T* out);
+      void Convolute(batch_pdf const& pdf, size_t const& NPDF, T* out, ConvolutionWorkspace<T>& ws);
+
+      // ******************** FKBundle Get Methods ***************************
+
+      int GetNVariations() const { return fHeaders.size(); } //!< Return the number of variations K
+      int GetNData()   const { return fNData;   }  //!< Return the number of datapoints
+      int GetNx()      const { return fNx;      }  //!< Return the number of x-points
+      int GetTx()      const { return fTx;      }  //!< Return the number of elements per channel
+      int GetNonZero() const { return fNonZero; }  //!< Return the number of channels in the union of the variations
+      int GetDSz()     const { return fDSz;     }  //!< Return the row stride of the sigma block
+      double GetQ20()  const { return fQ20;     }  //!< Return the squared initial scale
+      bool IsHadronic() const { return fHadronic; } //!< Return the hadronic flag
+
+      const double* GetXGrid() const { return &fXgrid[0]; } //!< Return the x-grid
+      const int* GetFlmap() const { return &fFlmap[0]; }    //!< Return the union flavour map
+      const T* GetSigma() const { return fSigma; }          //!< Return the sigma block, [datapoint][variation][fDSz]
+      FKHeader const& GetHeader(int const& k) const { return fHeaders[k]; } //!< Return the header of variation k
+
+    private:
+      FKBundle();                           //!< Disable default constructor
+      FKBundle(FKBundle const&);            //!< Disable copy-construction
+      FKBundle& operator=(FKBundle const&); //!< Disable copy-assignment
+
+      void Initialise(); //!< Check the compatibility of fHeaders and allocate the bundle
+      void Pack(int const& k, FKTable<T> const& table); //!< Copy table into variation k
+      void ConvoluteEvaluated(const T* evln, size_t const& NPDF, T* out, ConvolutionWorkspace<T>& ws); //!< Convolution with evaluated PDFs
+
+      std::vector<FKHeader> fHeaders;  //!< Header of each variation
+
+      int fNData;
+      int fNx;
+      int fTx;
+      double fQ20;
+      bool fHadronic;
+      int fNonZero;                    //!< Channels in the union of the variations
+      std::vector<int> fFlmap;         //!< Union flavour map
+      std::vector<int> fChannel;       //!< Union channel of each flavour (pair), -1 if inactive
+
+      const FKKernel<T>& fKernel;
+      int fDSz;                        //!< Row stride, padded to FK_ALIGN bytes (rowAlign<T>() elements)
+      std::vector<double> fXgrid;
+      T* fSigma;                       //!< [datapoint][variation][fDSz]
+  };
+
+  /**
+   * @brief FKBundle constructor, loading one FK table per variation
+   * The headers of all variations are read and checked first, and the tables are then
+   * loaded one at a time, such that only the bundle and one table are held at once.
+   * @param filenames The FK table of each variation
+   * @param cFactors A vector of C-factor filenames for each variation, or empty for none
+   */
+  template<typename T>
+  FKBundle<T>::FKBundle(std::vector<std::string> const& filenames, std::vector<std::vector<std::string> > const& cFactors):
+  fHeaders(),
+  fKernel(NNPDF::GetKernel<T>()),
+  fSigma(NULL)
+  {
+    if (cFactors.size() != 0 && cFactors.size() != filenames.size())
+      throw std::runtime_error("FKBundle::FKBundle C-factors must be given for every variation, or none");
+
+    for (size_t k=0; k<filenames.size(); k++)
+      fHeaders.push_back(FKHeader(filenames[k]));
+    Initialise();
+
+    for (size_t k=0; k<filenames.size(); k++)
+    {
+      const FKTable<T> table(filenames[k], cFactors.size() ? cFactors[k]:std::vector<std::string>());
+      Pack(k, table);
+    }
+  }
+
+  /**
+   * @brief FKBundle constructor, copying one FK table per variation
+   * @param tables The FK table of each variation, which need not outlive the bundle
+   */
+  template<typename T>
+  FKBundle<T>::FKBundle(std::vector<const FKTable<T>*> const& tables):
+  fHeaders(),
+  fKernel(NNPDF::GetKernel<T>()),
+  fSigma(NULL)
+  {
+    for (size_t k=0; k<tables.size(); k++)
+      fHeaders.push_back(*tables[k]);
+    Initialise();
+
+    for (size_t k=0; k<tables.size(); k++)
+      Pack(k, *tables[k]);
+  }
+
+  /**
+   * @brief FKBundle destructor
+   */
+  template<typename T>
+  FKBundle<T>::~FKBundle()
+  {
+    free(fSigma);
+  }
+
+  /**
+   * @brief Check that the variations describe the same datapoints on the same grid,
+   * build the union flavour map and allocate the zeroed sigma block
+   */
+  template<typename T>
+  void FKBundle<T>::Initialise()
+  {
+    if (fHeaders.size() == 0)
+      throw std::runtime_error("FKBundle::Initialise no FK tables provided");
+
+    FKHeader const& lead = fHeaders[0];
+    fNData    = lead.GetTag<int>(FKHeader::GRIDINFO, "NDATA");
+    fNx       = lead.GetTag<int>(FKHeader::GRIDINFO, "NX");
+    fHadronic = lead.GetTag<bool>(FKHeader::GRIDINFO, "HADRONIC");
+    fQ20      = std::pow(lead.GetTag<double>(FKHeader::THEORYINFO, "Q0"), 2);
+    fTx       = fHadronic ? fNx*fNx:fNx;
+
+    // Union of the active channels, in the order of the flavour map
+    const int nFL = 14;
+    const int nch = fHadronic ? nFL*nFL:nFL;
+    std::vector<bool> active(nch, false);
+    for (size_t k=0; k<fHeaders.size(); k++)
+    {
+      FKHeader const& h = fHeaders[k];
+      const std::string name = h.GetTag(FKHeader::GRIDINFO, "SETNAME");
+      if (h.GetTag<int>(FKHeader::GRIDINFO, "NDATA") != fNData || h.GetTag<int>(FKHeader::GRIDINFO, "NX") != fNx ||
+          h.GetTag<bool>(FKHeader::GRIDINFO, "HADRONIC") != fHadronic ||
+          std::pow(h.GetTag<double>(FKHeader::THEORYINFO, "Q0"), 2) != fQ20)
+        throw std::runtime_error("FKBundle::Initialise variation " + ToString(k) + " (" + name + ") is incompatible with variation 0");
+
+      std::stringstream fmBlob(h.GetTag(FKHeader::BLOB, "FlavourMap"));
+      for (int c=0; c<nch; c++)
+      {
+        bool iNonZero = false; fmBlob >> iNonZero;
+        if (fmBlob.fail())
+          throw std::runtime_error("FKBundle::Initialise FlavourMap formatting error in variation " + ToString(k) + " (" + name + ")");
+        active[c] = active[c] || iNonZero;
+      }
+    }
+
+    fChannel.assign(nch, -1);
+    fFlmap.clear();
+    fNonZero = 0;
+    for (int c=0; c<nch; c++)
+      if (active[c])
+      {
+        fChannel[c] = fNonZero++;
+        if (fHadronic)
+        {
+          fFlmap.push_back(c/nFL);
+          fFlmap.push_back(c%nFL);
+        }
+        else
+          fFlmap.push_back(c);
+      }
+
+    const int rmr = fTx*fNonZero % rowAlign<T>();
+    fDSz = fTx*fNonZero + (rmr == 0 ? 0:rowAlign<T>() - rmr);
+
+    const size_t nsig = size_t(fDSz)*fHeaders.size()*fNData;
+    fSigma = alignedAlloc<T>(nsig);
+    std::fill(fSigma, fSigma + nsig, T(0));
+  }
+
+  /**
+   * @brief Copy the channels of table into variation k
+   */
+  template<typename T>
+  void FKBundle<T>::Pack(int const& k, FKTable<T> const& table)
+  {
+    const int nFL = 14;
+    if (k == 0)
+      fXgrid.assign(table.GetXGrid(), table.GetXGrid() + fNx);
+    else if (!std::equal(fXgrid.begin(), fXgrid.end(), table.GetXGrid()))
+      throw std::runtime_error("FKBundle::Pack x-grid of variation " + ToString(k) + " (" + table.GetDataName() + ") differs from variation 0");
+
+    const int K = fHeaders.size();
+    const int* flmap = table.GetFlmap();
+    std::vector<T> row(table.IsCompact() ? table.GetDSz():0);
+    for (int d=0; d<fNData; d++)
+    {
+      const T* sig = table.GetSigmaRow(d, row.data());
+      for (int j=0; j<table.GetNonZero(); j++)
+      {
+        const int u = fChannel[fHadronic ? nFL*flmap[2*j] + flmap[2*j+1]:flmap[j]];
+        const T* src = sig + size_t(j)*fTx;
+        std::copy(src, src + fTx, fSigma + (size_t(d)*K + k)*fDSz + size_t(u)*fTx);
+      }
+    }
+  }
+
+  // Perform convolution of all variations
+  template<typename T>
+  void FKBundle<T>::Convolute(extern_pdf pdf, size_t const& NPDF, T* out)
+  {
+    ConvolutionWorkspace<T> ws;
+    Convolute(pdf, NPDF, out, ws);
+  }
+
+  // Perform convolution of all variations, reusing a workspace
+  template<typename T>
+  void FKBundle<T>::Convolute(extern_pdf pdf, size_t const& NPDF, T* out, ConvolutionWorkspace<T>& ws)
+  {
+    ConvoluteEvaluated(ws.EvaluatePDF(pdf, &fXgrid[0], fNx, sqrt(fQ20), NPDF), NPDF, out, ws);
+  }
+
+  // Perform convolution of all variations with a batched PDF callback
+  template<typename T>
+  void FKBundle<T>::Convolute(batch_pdf const& pdf, size_t const& NPDF, T* out)
+  {
+    ConvolutionWorkspace<T> ws;
+    Convolute(pdf, NPDF, out, ws);
+  }
+
+  // Perform convolution of all variations with a batched PDF callback, reusing a workspace
+  template<typename T>
+  void FKBundle<T>::Convolute(batch_pdf const& pdf, size_t const& NPDF, T* out, ConvolutionWorkspace<T>& ws)
+  {
+    ConvoluteEvaluated(ws.EvaluatePDF(pdf, &fXgrid[0], fNx, sqrt(fQ20), NPDF), NPDF, out, ws);
+  }
+
+  /**
+   * @brief Convolution of all variations with evaluated PDFs. The luminosity is cached once
+   * for the union of channels. Large replica ensembles take the tiled kernel over all rows, as
+   * FKTable::Convolute; otherwise datapoints are distributed over threads, and the K contiguous
+   * rows of each datapoint are applied to all members by the tiled kernel, such that each
+   * luminosity tile is read once per datapoint rather than once per variation.
+   */
+  template<typename T>
+  void FKBundle<T>::ConvoluteEvaluated(const T* evln, size_t const& NPDF, T* out, ConvolutionWorkspace<T>& ws)
+  {
+    APFELGRID_PROFILE_SCOPE("FKBundle::Convolute");
+    const int K = fHeaders.size();
+    APFELGRID_PROFILE_COUNT("FKBundle::ConvoluteFlops", 2*uint64_t(fNData)*K*fTx*fNonZero*NPDF);
+
+    T* pdf = ws.Scratch(0, size_t(fDSz)*NPDF);
+    cacheLuminosity(evln, NPDF, fNx, fTx, fNonZero, &fFlmap[0], fHadronic, fDSz, pdf);
+
+    if (NPDF >= FK_MULTI_NPDF)
+    {
+      convoluteMulti(fKernel, fSigma, fNData*K, pdf, NPDF, fDSz, out, NPDF);
+      return;
+    }
+
+#if APFELGRID_HAVE_OMP == 1
+#pragma omp parallel for
+#endif
+    for (int d = 0; d < fNData; d++)
+      convoluteMulti(fKernel, fSigma + size_t(d)*K*fDSz, K, pdf, NPDF, fDSz, out + size_t(d)*K*NPDF, NPDF, false);
+  }
+
+}
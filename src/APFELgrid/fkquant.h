@@ -0,0 +1,652 @@
+// The MIT License (MIT)
+
+// Copyright (c) Stefano Carrazza, Luigi Del Debbio, Nathan Hartland
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+#include "fastkernel.h"
+
+namespace NNPDF
+{
+ /**
+  * \enum FKPrecision
+  * \brief Reduced-precision storage formats of FKQuantisedTable
+  */
+  enum FKPrecision
+  {
+    FK_FP16,          //!< IEEE half precision, with a power-of-two scale per datapoint
+    FK_BF16,          //!< bfloat16, the upper half of an IEEE single, with a power-of-two scale per datapoint
+    FK_INT16_ROW,     //!< 16-bit integers with a scale per datapoint
+    FK_INT16_CHANNEL  //!< 16-bit integers with a scale per datapoint and flavour channel
+  };
+
+  // Name of a storage precision
+  inline const char* precisionName(FKPrecision const& precision)
+  {
+    static const char* names[] = {"fp16", "bf16", "int16/row", "int16/channel"};
+    return names[precision];
+  }
+
+ // 16-bit conversions ***********************************************************************
+
+  // Round a float to the nearest IEEE half, ties to even
+  inline uint16_t toHalf(float const& f)
+  {
+    uint32_t u;
+    memcpy(&u, &f, sizeof(u));
+    const uint16_t sign = (u >> 16) & 0x8000;
+    const uint32_t a = u & 0x7fffffff;
+    if (a >= 0x47800000) // Beyond the half range, or not finite
+      return sign | (a > 0x7f800000 ? 0x7e00:0x7c00);
+    if (a < 0x38800000)  // Subnormal half, multiples of 2^-24
+      return sign | (uint16_t) std::nearbyint(std::fabs(f)*16777216.0f);
+    return sign | ((a - 0x38000000 + 0xfff + ((a >> 13) & 1)) >> 13);
+  }
+
+  // Widen an IEEE half to float
+  inline float fromHalf(uint16_t const& h)
+  {
+    const uint32_t e = (h >> 10) & 0x1f;
+    const uint32_t m = h & 0x3ff;
+    if (e == 0)
+      return (h & 0x8000 ? -5.9604644775390625e-8f:5.9604644775390625e-8f)*m;
+    const uint32_t u = (uint32_t(h & 0x8000) << 16) | (e == 31 ? 0x7f800000:(e + 112) << 23) | (m << 13);
+    float f;
+    memcpy(&f, &u, sizeof(f));
+    return f;
+  }
+
+  // Round a float to the nearest bfloat16, ties to even
+  inline uint16_t toBF16(float const& f)
+  {
+    uint32_t u;
+    memcpy(&u, &f, sizeof(u));
+    if ((u & 0x7fffffff) > 0x7f800000)
+      return (u >> 16) | 0x40;
+    return (u + 0x7fff + ((u >> 16) & 1)) >> 16;
+  }
+
+  // Widen a bfloat16 to float
+  inline float fromBF16(uint16_t const& b)
+  {
+    const uint32_t u = uint32_t(b) << 16;
+    float f;
+    memcpy(&f, &u, sizeof(f));
+    return f;
+  }
+
+ // Decode kernels *************************************************************************
+ // Dot products of stored 16-bit values, widened on the fly, with PDF rows of precision T.
+ // The format F is FK_FP16, FK_BF16, or FK_INT16_ROW for both integer precisions. Unlike
+ // the FKKernel kernels, any length and alignment is accepted.
+
+  template<int F>
+  static inline float decode(uint16_t const& q)
+  {
+    if (F == FK_FP16) return fromHalf(q);
+    if (F == FK_BF16) return fromBF16(q);
+    return (float) (int16_t) q;
+  }
+
+  // Scalar dot product
+  template<int F, typename T>
+  static void quantDot_scalar(const uint16_t* __restrict__ q, const T* __restrict__ pdf, int const& n, T& retval)
+  {
+    T acc = 0;
+    for (int i = 0; i < n; i++)
+      acc += decode<F>(q[i])*pdf[i];
+    retval = acc;
+  }
+
+  // Scalar tile: res[c] = q . pdf[c] for FK_NR PDF rows
+  template<int F, typename T>
+  static void quantTile_scalar(const uint16_t* __restrict__ q, const T* __restrict__ pdf, int const& pld, int const& n, T* res)
+  {
+    T acc[FK_NR] = {0};
+    for (int i = 0; i < n; i++)
+    {
+      const T s = decode<F>(q[i]);
+      for (int c = 0; c < FK_NR; c++)
+        acc[c] += s*pdf[c*pld+i];
+    }
+    std::copy(acc, acc + FK_NR, res);
+  }
+
+#if APFELGRID_DISPATCH == 1
+  // AVX2 kernels, 8 values per step ***********************************************
+
+  template<int F>
+  __attribute__((target("avx2,fma,f16c"))) static inline __m256 widen_avx2(const uint16_t* q)
+  {
+    const __m128i v = _mm_loadu_si128((const __m128i*) q);
+    if (F == FK_FP16) return _mm256_cvtph_ps(v);
+    if (F == FK_BF16) return _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_cvtepu16_epi32(v), 16));
+    return _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(v));
+  }
+
+  template<int F>
+  __attribute__((target("avx2,fma,f16c"))) static void quantDot_avx2(const uint16_t* __restrict__ q, const float* __restrict__ pdf, int const& n, float& retval)
+  {
+    __m256 acc = _mm256_setzero_ps();
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+      acc = _mm256_fmadd_ps(widen_avx2<F>(q+i), _mm256_loadu_ps(pdf+i), acc);
+    float tail = 0;
+    for (; i < n; i++)
+      tail += decode<F>(q[i])*pdf[i];
+    retval = hsum_avx(acc) + tail;
+  }
+
+  template<int F>
+  __attribute__((target("avx2,fma,f16c"))) static void quantDot_avx2(const uint16_t* __restrict__ q, const double* __restrict__ pdf, int const& n, double& retval)
+  {
+    __m256d acc0 = _mm256_setzero_pd();
+    __m256d acc1 = _mm256_setzero_pd();
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+      const __m256 s = widen_avx2<F>(q+i);
+      acc0 = _mm256_fmadd_pd(_mm256_cvtps_pd(_mm256_castps256_ps128(s)), _mm256_loadu_pd(pdf+i), acc0);
+      acc1 = _mm256_fmadd_pd(_mm256_cvtps_pd(_mm256_extractf128_ps(s, 1)), _mm256_loadu_pd(pdf+i+4), acc1);
+    }
+    double tail = 0;
+    for (; i < n; i++)
+      tail += decode<F>(q[i])*pdf[i];
+    retval = hsum_avx(_mm256_add_pd(acc0, acc1)) + tail;
+  }
+
+  template<int F>
+  __attribute__((target("avx2,fma,f16c"))) static void quantTile_avx2(const uint16_t* __restrict__ q, const float* __restrict__ pdf, int const& pld, int const& n, float* res)
+  {
+    __m256 acc[FK_NR];
+    for (int c=0; c<FK_NR; c++) acc[c] = _mm256_setzero_ps();
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+      const __m256 s = widen_avx2<F>(q+i);
+      for (int c=0; c<FK_NR; c++)
+        acc[c] = _mm256_fmadd_ps(s, _mm256_loadu_ps(pdf + c*pld + i), acc[c]);
+    }
+    for (int c=0; c<FK_NR; c++)
+    {
+      res[c] = hsum_avx(acc[c]);
+      for (int k = i; k < n; k++)
+        res[c] += decode<F>(q[k])*pdf[c*pld+k];
+    }
+  }
+
+  template<int F>
+  __attribute__((target("avx2,fma,f16c"))) static void quantTile_avx2(const uint16_t* __restrict__ q, const double* __restrict__ pdf, int const& pld, int const& n, double* res)
+  {
+    __m256d acc[FK_NR];
+    for (int c=0; c<FK_NR; c++) acc[c] = _mm256_setzero_pd();
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+      const __m256 s = widen_avx2<F>(q+i);
+      const __m256d lo = _mm256_cvtps_pd(_mm256_castps256_ps128(s));
+      const __m256d hi = _mm256_cvtps_pd(_mm256_extractf128_ps(s, 1));
+      for (int c=0; c<FK_NR; c++)
+      {
+        acc[c] = _mm256_fmadd_pd(lo, _mm256_loadu_pd(pdf + c*pld + i), acc[c]);
+        acc[c] = _mm256_fmadd_pd(hi, _mm256_loadu_pd(pdf + c*pld + i + 4), acc[c]);
+      }
+    }
+    for (int c=0; c<FK_NR; c++)
+    {
+      res[c] = hsum_avx(acc[c]);
+      for (int k = i; k < n; k++)
+        res[c] += decode<F>(q[k])*pdf[c*pld+k];
+    }
+  }
+
+  // AVX-512 kernels, 16 values per step *******************************************
+
+  template<int F>
+  __attribute__((target("avx512f"))) static inline __m512 widen_avx512(const uint16_t* q)
+  {
+    // Zero-masked conversions, the unmasked ones trip -Wmaybe-uninitialized in GCC 12
+    const __m256i v = _mm256_loadu_si256((const __m256i*) q);
+    const __mmask16 all = 0xffff;
+    if (F == FK_FP16) return _mm512_maskz_cvtph_ps(all, v);
+    if (F == FK_BF16) return _mm512_castsi512_ps(_mm512_maskz_slli_epi32(all, _mm512_maskz_cvtepu16_epi32(all, v), 16));
+    return _mm512_maskz_cvtepi32_ps(all, _mm512_maskz_cvtepi16_epi32(all, v));
+  }
+
+  // Lower and upper eight values of a widened step, in double precision
+  __attribute__((target("avx512f"))) static inline __m512d lower_avx512(__m512 const& s)
+  {
+    return _mm512_maskz_cvtps_pd(0xff, _mm256_castpd_ps(_mm512_maskz_extractf64x4_pd(0xf, _mm512_castps_pd(s), 0)));
+  }
+
+  __attribute__((target("avx512f"))) static inline __m512d upper_avx512(__m512 const& s)
+  {
+    return _mm512_maskz_cvtps_pd(0xff, _mm256_castpd_ps(_mm512_maskz_extractf64x4_pd(0xf, _mm512_castps_pd(s), 1)));
+  }
+
+  template<int F>
+  __attribute__((target("avx512f"))) static void quantDot_avx512(const uint16_t* __restrict__ q, const float* __restrict__ pdf, int const& n, float& retval)
+  {
+    __m512 acc = _mm512_setzero_ps();
+    int i = 0;
+    for (; i + 16 <= n; i += 16)
+      acc = _mm512_fmadd_ps(widen_avx512<F>(q+i), _mm512_loadu_ps(pdf+i), acc);
+    float tail = 0;
+    for (; i < n; i++)
+      tail += decode<F>(q[i])*pdf[i];
+    retval = hsum_avx512(acc) + tail;
+  }
+
+  template<int F>
+  __attribute__((target("avx512f"))) static void quantDot_avx512(const uint16_t* __restrict__ q, const double* __restrict__ pdf, int const& n, double& retval)
+  {
+    __m512d acc0 = _mm512_setzero_pd();
+    __m512d acc1 = _mm512_setzero_pd();
+    int i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+      const __m512 s = widen_avx512<F>(q+i);
+      acc0 = _mm512_fmadd_pd(lower_avx512(s), _mm512_loadu_pd(pdf+i), acc0);
+      acc1 = _mm512_fmadd_pd(upper_avx512(s), _mm512_loadu_pd(pdf+i+8), acc1);
+    }
+    double tail = 0;
+    for (; i < n; i++)
+      tail += decode<F>(q[i])*pdf[i];
+    retval = hsum_avx512(_mm512_add_pd(acc0, acc1)) + tail;
+  }
+
+  template<int F>
+  __attribute__((target("avx512f"))) static void quantTile_avx512(const uint16_t* __restrict__ q, const float* __restrict__ pdf, int const& pld, int const& n, float* res)
+  {
+    __m512 acc[FK_NR];
+    for (int c=0; c<FK_NR; c++) acc[c] = _mm512_setzero_ps();
+    int i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+      const __m512 s = widen_avx512<F>(q+i);
+      for (int c=0; c<FK_NR; c++)
+        acc[c] = _mm512_fmadd_ps(s, _mm512_loadu_ps(pdf + c*pld + i), acc[c]);
+    }
+    for (int c=0; c<FK_NR; c++)
+    {
+      res[c] = hsum_avx512(acc[c]);
+      for (int k = i; k < n; k++)
+        res[c] += decode<F>(q[k])*pdf[c*pld+k];
+    }
+  }
+
+  template<int F>
+  __attribute__((target("avx512f"))) static void quantTile_avx512(const uint16_t* __restrict__ q, const double* __restrict__ pdf, int const& pld, int const& n, double* res)
+  {
+    __m512d acc[FK_NR];
+    for (int c=0; c<FK_NR; c++) acc[c] = _mm512_setzero_pd();
+    int i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+      const __m512 s = widen_avx512<F>(q+i);
+      const __m512d lo = lower_avx512(s);
+      const __m512d hi = upper_avx512(s);
+      for (int c=0; c<FK_NR; c++)
+      {
+        acc[c] = _mm512_fmadd_pd(lo, _mm512_loadu_pd(pdf + c*pld + i), acc[c]);
+        acc[c] = _mm512_fmadd_pd(hi, _mm512_loadu_pd(pdf + c*pld + i + 8), acc[c]);
+      }
+    }
+    for (int c=0; c<FK_NR; c++)
+    {
+      res[c] = hsum_avx512(acc[c]);
+      for (int k = i; k < n; k++)
+        res[c] += decode<F>(q[k])*pdf[c*pld+k];
+    }
+  }
+#endif
+
+ /**
+  * \struct FKQuantKernel
+  * \brief Decode kernels for one SIMD target and precision, indexed by storage format
+  */
+  template<typename T>
+  struct FKQuantKernel
+  {
+    const char* name;  //!< Target name: scalar, avx2 or avx512
+    void (*dot[3])(const uint16_t*, const T*, int const&, T&);              //!< Dot product
+    void (*tile[3])(const uint16_t*, const T*, int const&, int const&, T*); //!< FK_NR replica tile
+  };
+
+  /**
+   * Returns the decode kernels matching the active convolution kernel of precision T
+   * (see SetKernel). Targets without decode kernels use the scalar ones.
+   */
+  template<typename T>
+  FKQuantKernel<T> const& GetQuantKernel()
+  {
+    static const FKQuantKernel<T> scalar = {"scalar",
+      {quantDot_scalar<FK_FP16,T>,  quantDot_scalar<FK_BF16,T>,  quantDot_scalar<FK_INT16_ROW,T>},
+      {quantTile_scalar<FK_FP16,T>, quantTile_scalar<FK_BF16,T>, quantTile_scalar<FK_INT16_ROW,T>}};
+#if APFELGRID_DISPATCH == 1
+    static const FKQuantKernel<T> avx512 = {"avx512",
+      {quantDot_avx512<FK_FP16>,  quantDot_avx512<FK_BF16>,  quantDot_avx512<FK_INT16_ROW>},
+      {quantTile_avx512<FK_FP16>, quantTile_avx512<FK_BF16>, quantTile_avx512<FK_INT16_ROW>}};
+    static const FKQuantKernel<T> avx2 = {"avx2",
+      {quantDot_avx2<FK_FP16>,  quantDot_avx2<FK_BF16>,  quantDot_avx2<FK_INT16_ROW>},
+      {quantTile_avx2<FK_FP16>, quantTile_avx2<FK_BF16>, quantTile_avx2<FK_INT16_ROW>}};
+
+    const std::string name = GetKernel<T>().name;
+    __builtin_cpu_init();
+    if (name == "avx512")
+      return avx512;
+    if (name == "avx2" && __builtin_cpu_supports("f16c"))
+      return avx2;
+#endif
+    return scalar;
+  }
+
+ /**
+  * \struct FKPrecisionReport
+  * \brief Error of the reduced-precision sigma against the table it was quantised from
+  */
+  struct FKPrecisionReport
+  {
+    std::vector<double> maxrel; //!< Largest error of an entry of each datapoint, relative to its largest entry
+    std::vector<double> l1rel;  //!< Summed error of each datapoint, relative to its summed entries
+
+    // Return the largest relative error over datapoints, and the datapoint at which it occurs
+    double MaxRel(int& d) const
+    {
+      d = std::max_element(maxrel.begin(), maxrel.end()) - maxrel.begin();
+      return maxrel.empty() ? 0:maxrel[d];
+    }
+
+    double MaxL1Rel(int& d) const
+    {
+      d = std::max_element(l1rel.begin(), l1rel.end()) - l1rel.begin();
+      return l1rel.empty() ? 0:l1rel[d];
+    }
+  };
+
+ /**
+  * \class FKQuantisedTable
+  * \brief FK table with sigma stored in 16 bits per element
+  *
+  * Convolution of FK tables is bound by the memory bandwidth of the sigma block. The
+  * quantised table holds sigma in one of the 16-bit FKPrecision formats, half of the
+  * storage of FKTable<float>, and widens it on the fly to accumulators of precision T.
+  * Each datapoint (or datapoint channel, for FK_INT16_CHANNEL) carries a scale, such
+  * that the stored values span the range of the format. The errors against the source
+  * table are recorded per datapoint in a FKPrecisionReport.
+  */
+  template<typename T>
+  class FKQuantisedTable
+  {
+    public:
+      typedef typename FKTable<T>::extern_pdf extern_pdf;
+      typedef typename FKTable<T>::batch_pdf  batch_pdf;
+
+      template<typename S>
+      FKQuantisedTable(FKTable<S> const& table, FKPrecision const& precision);   //!< Quantise the sigma block of table
+      FKQuantisedTable(std::string const& filename, FKPrecision const& precision,
+                       std::vector<std::string> const& cFactors = std::vector<std::string>()); //!< Quantise a table read in double precision
+
+      void Convolute(extern_pdf pdf, size_t const& NPDF, T* out);
+      void Convolute(extern_pdf pdf, size_t const& NPDF, T* out, ConvolutionWorkspace<T>& ws); //!< Convolution reusing a workspace
+      void Convolute(batch_pdf const& pdf, size_t const& NPDF, T* out);
+      void Convolute(batch_pdf const& pdf, size_t const& NPDF, T* out, ConvolutionWorkspace<T>& ws);
+
+      // ******************** FKQuantisedTable Get Methods ***************************
+
+      std::string const& GetDataName() const { return fDataName; }
+      double const& GetQ20()        const { return fQ20;      }
+      int const&    GetNData()      const { return fNData;    }  //!< Return the number of datapoints
+      int const&    GetNx()         const { return fNx;       }  //!< Return the number of x-points
+      int const&    GetNonZero()    const { return fNonZero;  }  //!< Return the number of flavour channels
+      bool const&   IsHadronic()    const { return fHadronic; }
+      const double* GetXGrid()      const { return &fXgrid[0]; }
+      FKPrecision const& GetPrecision() const { return fPrecision; }            //!< Return the storage format
+      FKPrecisionReport const& GetReport() const { return fReport; }            //!< Return the quantisation errors
+      const char*   GetKernelName() const { return fKernel.name; }              //!< Return the name of the decode kernel
+      size_t GetBytes() const { return size_t(fNData)*fDSz*sizeof(uint16_t) + fScale.size()*sizeof(T); } //!< Return the memory held by sigma and its scales
+
+    private:
+      FKQuantisedTable();                                   //!< Disable default constructor
+      FKQuantisedTable& operator=(FKQuantisedTable const&); //!< Disable copy-assignment
+
+      template<typename S>
+      void Quantise(FKTable<S> const& table); //!< Fill sigma and the scales, and the precision report
+      void ConvoluteEvaluated(const T* evln, size_t const& NPDF, T* out, ConvolutionWorkspace<T>& ws) const; //!< Convolution with evaluated PDFs
+
+      const std::string fDataName;
+      const int fNData;
+      const int fNx;
+      const int fTx;
+      const int fNonZero;
+      const int fDSz;            //!< Row length of sigma, padded to FK_ALIGN bytes
+      const bool fHadronic;
+      const double fQ20;
+      const std::vector<double> fXgrid;
+      const std::vector<int> fFlmap;
+
+      const FKPrecision fPrecision;
+      const int fNScale;         //!< Scales per datapoint, fNonZero (FK_INT16_CHANNEL) or 1
+      std::shared_ptr<uint16_t> fSigma;  //!< Stored values, [d][fDSz]
+      std::vector<T> fScale;     //!< Scales, [d][fNScale]
+      FKQuantKernel<T> const& fKernel;
+      FKPrecisionReport fReport;
+  };
+
+  /**
+   * @brief FKQuantisedTable constructor
+   * @param table The FK table, which need not outlive the quantised table
+   * @param precision The storage format
+   */
+  template<typename T>
+  template<typename S>
+  FKQuantisedTable<T>::FKQuantisedTable(FKTable<S> const& table, FKPrecision const& precision):
+  fDataName(table.GetDataName()),
+  fNData(table.GetNData()),
+  fNx(table.GetNx()),
+  fTx(table.GetTx()),
+  fNonZero(table.GetNonZero()),
+  fDSz(((table.GetTx()*table.GetNonZero() + FK_ALIGN/2 - 1)/(FK_ALIGN/2))*(FK_ALIGN/2)),
+  fHadronic(table.IsHadronic()),
+  fQ20(table.GetQ20()),
+  fXgrid(table.GetXGrid(), table.GetXGrid() + table.GetNx()),
+  fFlmap(table.GetFlmap(), table.GetFlmap() + (table.IsHadronic() ? 2:1)*table.GetNonZero()),
+  fPrecision(precision),
+  fNScale(precision == FK_INT16_CHANNEL ? table.GetNonZero():1),
+  fSigma(alignedAlloc<uint16_t>(size_t(fNData)*fDSz), alignedFree()),
+  fScale(size_t(fNData)*fNScale, T(1)),
+  fKernel(GetQuantKernel<T>()),
+  fReport()
+  {
+    if (precision < FK_FP16 || precision > FK_INT16_CHANNEL)
+      throw std::runtime_error("FKQuantisedTable::FKQuantisedTable unknown precision: " + ToString(precision));
+    Quantise(table);
+  }
+
+  /**
+   * @brief FKQuantisedTable constructor, from a table read in double precision
+   * @param filename The FK table file
+   * @param precision The storage format
+   * @param cFactors A vector of filenames for potential C-factors
+   */
+  template<typename T>
+  FKQuantisedTable<T>::FKQuantisedTable(std::string const& filename, FKPrecision const& precision, std::vector<std::string> const& cFactors):
+  FKQuantisedTable(FKTable<double>(filename, cFactors), precision)
+  {
+  }
+
+  /**
+   * @brief Quantise the sigma block of table. The float formats store sigma divided by a
+   * power of two, exactly, such that the largest entry of each datapoint is just below
+   * 2^15; FK_INT16_ROW and FK_INT16_CHANNEL map the largest entry of each datapoint or
+   * channel to 32767.
+   */
+  template<typename T>
+  template<typename S>
+  void FKQuantisedTable<T>::Quantise(FKTable<S> const& table)
+  {
+    const int len = fNScale == 1 ? fTx*fNonZero:fTx;
+    fReport.maxrel.resize(fNData, 0);
+    fReport.l1rel.resize(fNData, 0);
+
+#if APFELGRID_HAVE_OMP == 1
+#pragma omp parallel for schedule(dynamic)
+#endif
+    for (int d = 0; d < fNData; d++)
+    {
+      std::vector<S> row(table.IsCompact() ? table.GetDSz():0);
+      const S* sig = table.GetSigmaRow(d, row.data());
+      uint16_t* q = fSigma.get() + size_t(d)*fDSz;
+      double errmax = 0, errsum = 0, amax = 0, asum = 0;
+      for (int s = 0; s < fNScale; s++)
+      {
+        const int k0 = s*len;
+        double smax = 0;
+        for (int k = k0; k < k0 + len; k++)
+          smax = std::max(smax, std::fabs((double) sig[k]));
+
+        if (smax > 0)
+          fScale[size_t(d)*fNScale + s] = fPrecision >= FK_INT16_ROW ? T(smax/32767.0):T(std::ldexp(1.0, std::ilogb(smax) - 14));
+        const double scale = fScale[size_t(d)*fNScale + s];
+
+        for (int k = k0; k < k0 + len; k++)
+        {
+          const double x = sig[k]/scale;
+          double y = 0;
+          switch (fPrecision)
+          {
+            case FK_FP16: q[k] = toHalf((float) x); y = fromHalf(q[k]); break;
+            case FK_BF16: q[k] = toBF16((float) x); y = fromBF16(q[k]); break;
+            default:      q[k] = (uint16_t) (int16_t) std::max(-32767.0, std::min(32767.0, std::nearbyint(x))); y = (int16_t) q[k]; break;
+          }
+          const double err = std::fabs(y*scale - sig[k]);
+          errmax = std::max(errmax, err);
+          errsum += err;
+          amax = std::max(amax, std::fabs((double) sig[k]));
+          asum += std::fabs((double) sig[k]);
+        }
+      }
+      std::fill(q + fTx*fNonZero, q + fDSz, 0);
+      fReport.maxrel[d] = amax > 0 ? errmax/amax:0;
+      fReport.l1rel[d]  = asum > 0 ? errsum/asum:0;
+    }
+
+    if (Verbose)
+    {
+      int dmax, dl1;
+      const double maxrel = fReport.MaxRel(dmax);
+      const double l1rel = fReport.MaxL1Rel(dl1);
+      std::cout << "FKQuantisedTable: " << fDataName << " stored as " << precisionName(fPrecision) << ", "
+                << GetBytes() << " of " << size_t(table.GetDSz())*fNData*sizeof(S) << " bytes" << std::endl
+                << "FKQuantisedTable: max relative error " << maxrel << " (datapoint " << dmax << "), summed "
+                << l1rel << " (datapoint " << dl1 << ")" << std::endl;
+    }
+  }
+
+  // Perform convolution
+  template<typename T>
+  void FKQuantisedTable<T>::Convolute(extern_pdf pdf, size_t const& NPDF, T* out)
+  {
+    ConvolutionWorkspace<T> ws;
+    Convolute(pdf, NPDF, out, ws);
+  }
+
+  // Perform convolution, reusing a workspace
+  template<typename T>
+  void FKQuantisedTable<T>::Convolute(extern_pdf pdf, size_t const& NPDF, T* out, ConvolutionWorkspace<T>& ws)
+  {
+    ConvoluteEvaluated(ws.EvaluatePDF(pdf, &fXgrid[0], fNx, sqrt(fQ20), NPDF), NPDF, out, ws);
+  }
+
+  // Perform convolution with a batched PDF callback
+  template<typename T>
+  void FKQuantisedTable<T>::Convolute(batch_pdf const& pdf, size_t const& NPDF, T* out)
+  {
+    ConvolutionWorkspace<T> ws;
+    Convolute(pdf, NPDF, out, ws);
+  }
+
+  // Perform convolution with a batched PDF callback, reusing a workspace
+  template<typename T>
+  void FKQuantisedTable<T>::Convolute(batch_pdf const& pdf, size_t const& NPDF, T* out, ConvolutionWorkspace<T>& ws)
+  {
+    ConvoluteEvaluated(ws.EvaluatePDF(pdf, &fXgrid[0], fNx, sqrt(fQ20), NPDF), NPDF, out, ws);
+  }
+
+  /**
+   * @brief Convolution with evaluated PDFs. As in convoluteMulti, the work is split into
+   * blocks of FK_MC datapoints (single datapoints below FK_MULTI_NPDF replicas) and FK_NC
+   * replicas, and each stretch of FK_KC stored values is decoded once per FK_NR replicas.
+   * Stretches do not cross the scale segments.
+   */
+  template<typename T>
+  void FKQuantisedTable<T>::ConvoluteEvaluated(const T* evln, size_t const& Npdf, T* out, ConvolutionWorkspace<T>& ws) const
+  {
+    T* pdf = ws.Scratch(0, size_t(fDSz)*Npdf);
+    cacheLuminosity(evln, Npdf, fNx, fTx, fNonZero, &fFlmap[0], fHadronic, fDSz, pdf);
+
+    const int fmt = std::min((int) fPrecision, (int) FK_INT16_ROW);
+    const int len = fNScale == 1 ? fTx*fNonZero:fTx;
+    const int nChunks = (Npdf + FK_NC - 1)/FK_NC;
+    const int MC = Npdf >= FK_MULTI_NPDF ? FK_MC:1;
+    const int nBlocks = (fNData + MC - 1)/MC;
+
+#if APFELGRID_HAVE_OMP == 1
+#pragma omp parallel for schedule(dynamic)
+#endif
+    for (int t = 0; t < nChunks*nBlocks; t++)
+    {
+      const size_t p0 = size_t(t % nChunks)*FK_NC;
+      const size_t p1 = std::min(Npdf, p0 + FK_NC);
+      const int d0 = (t / nChunks)*MC;
+      const int d1 = std::min(fNData, d0 + MC);
+      for (int d = d0; d < d1; d++)
+        std::fill(out + d*Npdf + p0, out + d*Npdf + p1, T(0));
+
+      T acc[FK_NR];
+      for (int s = 0; s < fNScale; s++)
+        for (int k0 = s*len; k0 < (s+1)*len; k0 += FK_KC)
+        {
+          const int kc = std::min(FK_KC, (s+1)*len - k0);
+          for (int d = d0; d < d1; d++)
+          {
+            const uint16_t* q = fSigma.get() + size_t(d)*fDSz + k0;
+            const T scale = fScale[size_t(d)*fNScale + s];
+            T* res = out + d*Npdf;
+            size_t p = p0;
+            for (; p + FK_NR <= p1; p += FK_NR)
+            {
+              fKernel.tile[fmt](q, pdf + p*fDSz + k0, fDSz, kc, acc);
+              for (int c = 0; c < FK_NR; c++)
+                res[p + c] += scale*acc[c];
+            }
+            for (; p < p1; p++)
+            {
+              fKernel.dot[fmt](q, pdf + p*fDSz + k0, kc, acc[0]);
+              res[p] += scale*acc[0];
+            }
+          }
+        }
+    }
+  }
+
+}
@@ -0,0 +1,353 @@
+// The MIT License (MIT)
+
+// Copyright (c) Stefano Carrazza, Luigi Del Debbio, Nathan Hartland
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include "fastkernel.h"
+#include "threadpool.h"
+
+namespace NNPDF
+{
+  // Datapoints per convolution task of FKSet
+  static const int FKSET_DBLOCK = 4;
+
+ /**
+  * \class FKSet
+  * \brief Convolution of many FK tables as a single dataset
+  *
+  * Convolution is split into a global list of (table, datapoint block, replica block)
+  * tasks, run on a work-stealing thread pool, with results written to one contiguous
+  * output array. Tables sharing an x-grid and initial scale share PDF evaluations and,
+  * in the factorised mode, the per-x PDF blocks. Each table is convoluted with its own
+  * convolution mode and kernel, giving results identical to FKTable::Convolute. Tables in
+  * the FK_BOXED mode use the box-pruned storage, or the luminosity where it prunes little.
+  *
+  * Convolute evaluates the PDF afresh on every call. Evaluations may instead be reused
+  * across calls by passing a ConvolutionWorkspace, such as GetWorkspace(), in which case
+  * the caller must invalidate it whenever the PDF changes (see ConvolutionWorkspace).
+  */
+  template<typename T>
+  class FKSet
+  {
+    public:
+      typedef typename FKTable<T>::extern_pdf extern_pdf;
+      typedef typename FKTable<T>::batch_pdf  batch_pdf;
+
+      FKSet(std::vector<FKTable<T>*> const& tables, int const& nthreads = 0); //!< Takes ownership of the tables
+      ~FKSet();
+
+      // Convolute all tables, out is [GetNData()][NPDF]
+      void Convolute(extern_pdf pdf, size_t const& NPDF, T* out);
+      void Convolute(batch_pdf const& pdf, size_t const& NPDF, T* out);
+      void Convolute(extern_pdf pdf, size_t const& NPDF, T* out, ConvolutionWorkspace<T>& ws);        //!< Convolution reusing a workspace
+      void Convolute(batch_pdf const& pdf, size_t const& NPDF, T* out, ConvolutionWorkspace<T>& ws); //!< Batched convolution reusing a workspace
+
+      // ******************** FKSet Get Methods ***************************
+
+      int GetNSet()   const { return fFK.size(); }  //!< Return the number of tables
+      int GetNData()  const { return fNData;     }  //!< Return the total number of datapoints
+      int GetNGroups() const { return fNGroups;  }  //!< Return the number of distinct (x-grid, Q0)
+      int GetDataOffset(int const& i) const { return fOffset[i]; } //!< Return the first datapoint of table i in the output
+      FKTable<T>* GetFK(int const& i) const { return fFK[i]; }     //!< Return table i
+
+      ConvolutionWorkspace<T>& GetWorkspace() { return fWS; } //!< Return the workspace used by Convolute
+      ThreadPool& GetPool() { return fPool; }                 //!< Return the thread pool
+
+    private:
+      FKSet();                        //!< Disable default constructor
+      FKSet(FKSet const&);            //!< Disable copy-construction
+      FKSet& operator=(FKSet const&); //!< Disable copy-assignment
+
+      void ConvoluteEvaluated(size_t const& NPDF, T* out); //!< Convolution once fEvln is set
+
+      std::vector<FKTable<T>*> fFK;
+      std::vector<int> fOffset;   //!< First datapoint of each table in the output
+      int fNData;
+
+      std::vector<int> fGroup;    //!< (x-grid, Q0) group of each table
+      std::vector<int> fLead;     //!< First table of each group
+      int fNGroups;
+
+      ThreadPool fPool;
+      ConvolutionWorkspace<T> fWS;
+
+      // Per-call state
+      std::vector<const T*> fEvln; //!< Evaluated PDFs of each table, [member][x][14]
+      std::vector<T*> fLumi;       //!< PDF luminosity of each table (FK_LUMINOSITY and FK_BOXED modes)
+      std::vector<size_t> fLumiSz;
+      std::vector<T*> fBlocks;     //!< Replica blocks of each group (FK_FACTORISED mode)
+      std::vector<size_t> fBlocksSz;
+  };
+
+  /**
+   * @brief FKSet constructor
+   * @param tables The FK tables, deleted with the FKSet
+   * @param nthreads Number of threads, 0 for the hardware concurrency
+   */
+  template<typename T>
+  FKSet<T>::FKSet(std::vector<FKTable<T>*> const& tables, int const& nthreads):
+  fFK(tables),
+  fOffset(tables.size(), 0),
+  fNData(0),
+  fGroup(tables.size(), -1),
+  fLead(),
+  fNGroups(0),
+  fPool(nthreads),
+  fWS(),
+  fEvln(tables.size(), NULL),
+  fLumi(tables.size(), NULL),
+  fLumiSz(tables.size(), 0),
+  fBlocks(),
+  fBlocksSz()
+  {
+    if (fFK.size() == 0)
+      throw std::runtime_error("FKSet::FKSet no FK tables provided");
+
+    for (size_t t=0; t<fFK.size(); t++)
+    {
+      fOffset[t] = fNData;
+      fNData += fFK[t]->GetNData();
+
+      // Group tables on the same x-grid and scale
+      const FKTable<T>* fk = fFK[t];
+      for (int g=0; g<fNGroups && fGroup[t] < 0; g++)
+      {
+        const FKTable<T>* lead = fFK[fLead[g]];
+        if (lead->GetQ20() == fk->GetQ20() && lead->GetNx() == fk->GetNx() &&
+            std::equal(fk->GetXGrid(), fk->GetXGrid() + fk->GetNx(), lead->GetXGrid()))
+          fGroup[t] = g;
+      }
+
+      if (fGroup[t] < 0)
+      {
+        fGroup[t] = fNGroups++;
+        fLead.push_back(t);
+      }
+    }
+
+    fBlocks.resize(fNGroups, NULL);
+    fBlocksSz.resize(fNGroups, 0);
+  }
+
+  /**
+   * @brief FKSet destructor
+   */
+  template<typename T>
+  FKSet<T>::~FKSet()
+  {
+    for (size_t t=0; t<fFK.size(); t++)
+    {
+      delete fFK[t];
+      free(fLumi[t]);
+    }
+    for (int g=0; g<fNGroups; g++)
+      free(fBlocks[g]);
+  }
+
+  // Perform convolution of all tables
+  template<typename T>
+  void FKSet<T>::Convolute(extern_pdf pdf, size_t const& NPDF, T* out)
+  {
+    fWS.Invalidate();
+    Convolute(pdf, NPDF, out, fWS);
+  }
+
+  // Perform convolution of all tables with a batched PDF callback
+  template<typename T>
+  void FKSet<T>::Convolute(batch_pdf const& pdf, size_t const& NPDF, T* out)
+  {
+    fWS.Invalidate();
+    Convolute(pdf, NPDF, out, fWS);
+  }
+
+  /**
+   * @brief Perform convolution of all tables, taking PDF evaluations from a workspace
+   * which may be reused across calls. The workspace must be invalidated when the PDF changes.
+   */
+  template<typename T>
+  void FKSet<T>::Convolute(extern_pdf pdf, size_t const& NPDF, T* out, ConvolutionWorkspace<T>& ws)
+  {
+    for (size_t t=0; t<fFK.size(); t++)
+      fEvln[t] = ws.EvaluatePDF(pdf, fFK[t]->fXgrid, fFK[t]->fNx, sqrt(fFK[t]->fQ20), NPDF);
+    ConvoluteEvaluated(NPDF, out);
+  }
+
+  // Perform convolution of all tables with a batched PDF callback, reusing a workspace
+  template<typename T>
+  void FKSet<T>::Convolute(batch_pdf const& pdf, size_t const& NPDF, T* out, ConvolutionWorkspace<T>& ws)
+  {
+    for (size_t t=0; t<fFK.size(); t++)
+      fEvln[t] = ws.EvaluatePDF(pdf, fFK[t]->fXgrid, fFK[t]->fNx, sqrt(fFK[t]->fQ20), NPDF);
+    ConvoluteEvaluated(NPDF, out);
+  }
+
+  // Perform convolution of all tables with evaluated PDFs
+  template<typename T>
+  void FKSet<T>::ConvoluteEvaluated(size_t const& NPDF, T* out)
+  {
+    APFELGRID_PROFILE_SCOPE("FKSet::Convolute");
+    const int NFL = 14;
+    std::vector<ThreadPool::Task> prepare, convolute;
+
+    // Box-pruned storage of each FK_BOXED table, NULL where the luminosity is used
+    std::vector<typename FKTable<T>::BoxStore const*> boxes(fFK.size(), NULL);
+    for (size_t t=0; t<fFK.size(); t++)
+      if ((fFK[t]->fMode == FK_BOXED || fFK[t]->IsCompact()) && !fFK[t]->GetBoxStore().dense)
+        boxes[t] = &fFK[t]->GetBoxStore();
+
+    // Phase 1: PDF luminosities per (table, replica chunk) or (boxed table, luminosity rows)
+    // and factorised blocks per group
+    const int NB = factorisedWidth(NPDF);
+    const size_t nBlocks = (NPDF + NB - 1)/NB;
+    std::vector<size_t> blockSz(fNGroups, 0);
+    for (size_t t=0; t<fFK.size(); t++)
+    {
+      FKTable<T>* fk = fFK[t];
+      const int g = fGroup[t];
+      if (boxes[t] != NULL)
+      {
+        typename FKTable<T>::BoxStore const* box = boxes[t];
+        const int nr = fk->fNonZero*box->nrow;
+        const size_t lumiSz = size_t(nr)*NPDF*box->stride;
+        if (fLumiSz[t] < lumiSz)
+        {
+          free(fLumi[t]);
+          fLumi[t] = NULL;
+          fLumiSz[t] = 0;
+          fLumi[t] = alignedAlloc<T>(lumiSz);
+          fLumiSz[t] = lumiSz;
+        }
+        const T* evln = fEvln[t];
+        T* lumi = fLumi[t];
+        const int RB = std::max(1, FK_NC/int(NPDF)); // Luminosity rows per task
+        for (int r0 = 0; r0 < nr; r0 += RB)
+        {
+          const int r1 = std::min(nr, r0 + RB);
+          prepare.push_back([=]() { fk->CacheBoxedPDF(*box, evln, NPDF, lumi, r0, r1); });
+        }
+      }
+      else if (fk->fMode == FK_FACTORISED)
+      {
+        if (blockSz[g] > 0) continue;
+        blockSz[g] = size_t(NFL)*fk->fNx*NB;
+        if (fBlocksSz[g] < blockSz[g]*nBlocks)
+        {
+          free(fBlocks[g]);
+          fBlocks[g] = NULL;
+          fBlocksSz[g] = 0;
+          fBlocks[g] = alignedAlloc<T>(blockSz[g]*nBlocks);
+          fBlocksSz[g] = blockSz[g]*nBlocks;
+        }
+        const T* evln = fEvln[t];
+        T* blocks = fBlocks[g];
+        const int nx = fk->fNx;
+        prepare.push_back([=]() { factorisedLayout(evln, NPDF, nx, NB, blocks); });
+      }
+      else
+      {
+        if (fLumiSz[t] < size_t(fk->fDSz)*NPDF)
+        {
+          free(fLumi[t]);
+          fLumi[t] = NULL;
+          fLumiSz[t] = 0;
+          fLumi[t] = alignedAlloc<T>(size_t(fk->fDSz)*NPDF);
+          fLumiSz[t] = size_t(fk->fDSz)*NPDF;
+        }
+        const T* evln = fEvln[t];
+        T* lumi = fLumi[t];
+        for (size_t n0 = 0; n0 < NPDF; n0 += FK_NC)
+        {
+          const size_t nb = std::min(NPDF - n0, (size_t) FK_NC);
+          prepare.push_back([=]() { fk->CachePDF(evln + n0*fk->fNx*NFL, nb, lumi + n0*fk->fDSz); });
+        }
+      }
+    }
+    fPool.Run(prepare);
+
+    // Phase 2: (table, datapoint block, replica block) convolutions
+    for (size_t t=0; t<fFK.size(); t++)
+    {
+      const FKTable<T>* fk = fFK[t];
+      for (int d0 = 0; d0 < fk->fNData; d0 += FKSET_DBLOCK)
+      {
+        const int d1 = std::min(fk->fNData, d0 + FKSET_DBLOCK);
+        T* res = out + size_t(fOffset[t])*NPDF;
+        if (fk->fMode == FK_FACTORISED)
+        {
+          const T* blocks = fBlocks[fGroup[t]];
+          const size_t bsz = blockSz[fGroup[t]];
+          for (size_t b = 0; b < nBlocks; b++)
+            convolute.push_back([=]()
+            {
+              const size_t n0 = b*NB;
+              const size_t nb = std::min(size_t(NB), NPDF - n0);
+              T acc[FK_FACT_NB];
+              for (int d = d0; d < d1; d++)
+              {
+                convoluteFactorisedBlock(NB, fk->fSigma + size_t(d)*fk->fDSz, blocks + b*bsz, fk->fNx, fk->fTx,
+                                         fk->fNonZero, fk->fFlmap, fk->fHadronic, acc);
+                for (size_t k = 0; k < nb; k++)
+                  res[d*NPDF + n0 + k] = acc[k];
+              }
+            });
+        }
+        else if (boxes[t] != NULL)
+        {
+          typename FKTable<T>::BoxStore const* box = boxes[t];
+          const T* lumi = fLumi[t];
+          for (size_t n0 = 0; n0 < NPDF; n0 += FK_NC)
+            convolute.push_back([=]()
+            {
+              const size_t n1 = std::min(NPDF, n0 + FK_NC);
+              for (int d = d0; d < d1; d++)
+                fk->ConvoluteBox(*box, lumi, NPDF, n0, n1, d, res + d*NPDF);
+            });
+        }
+        else
+        {
+          const T* lumi = fLumi[t];
+          for (size_t n0 = 0; n0 < NPDF; n0 += FK_NC)
+            convolute.push_back([=]()
+            {
+              const size_t nb = std::min(NPDF - n0, (size_t) FK_NC);
+              const int DSz = fk->fDSz;
+              if (NPDF >= FK_MULTI_NPDF)
+                convoluteMulti(fk->fKernel, fk->fSigma + size_t(d0)*DSz, d1 - d0, lumi + n0*DSz, nb, DSz,
+                               res + d0*NPDF + n0, NPDF, false);
+              else
+                for (int d = d0; d < d1; d++)
+                  for (size_t n = n0; n < n0 + nb; n++)
+                  {
+                    res[d*NPDF + n] = 0;
+                    fk->fKernel.dot(lumi + n*DSz, fk->fSigma + size_t(d)*DSz, res[d*NPDF + n], DSz);
+                  }
+            });
+        }
+      }
+    }
+    fPool.Run(convolute);
+
+    for (size_t t=0; t<fFK.size(); t++)
+      APFELGRID_PROFILE_COUNT("FKSet::ConvoluteFlops", fFK[t]->ConvoluteFlops(fFK[t]->fMode, NPDF, NULL, fFK[t]->fNData));
+  }
+
+}
@@ -0,0 +1,348 @@
+// The MIT License (MIT)
+
+// Copyright (c) Stefano Carrazza, Luigi Del Debbio, Nathan Hartland
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include "fastkernel.h"
+
+namespace NNPDF
+{
+  // Minimum width in elements of the blocks of FKSparseTable
+  static const int FK_SPARSE_WIDTH = 32;
+
+ /**
+  * \class FKSparseTable
+  * \brief Sparse (block-CSR) storage of FastKernel tables
+  *
+  * The (x1,x2) points (or x points for DIS) are grouped into blocks of GetNB() consecutive
+  * points, holding all active flavour channels, such that the block width is a multiple of
+  * the SIMD width of at least FK_SPARSE_WIDTH elements without padding. Only the blocks
+  * carrying a nonzero FK entry are stored, contiguously for each datapoint, with the first
+  * x-point of each held in fCol.
+  * The PDF cache holds only the blocks stored by some datapoint, in the same channel-inner
+  * format and in x-point order. Runs of blocks of a datapoint adjacent in the PDF cache are
+  * convoluted with a single dot product.
+  */
+  template<typename T>
+  class FKSparseTable
+  {
+    public:
+      FKSparseTable(FKTable<T> const&); //!< Construct from a dense FK table
+      FKSparseTable(std::string const& filename, std::vector<std::string> const& cFactors = std::vector<std::string>()); //!< Construct from an FK table file
+      ~FKSparseTable();                 //!< Destructor
+
+      typedef typename FKTable<T>::extern_pdf extern_pdf;
+      typedef typename FKTable<T>::batch_pdf  batch_pdf;
+      void Convolute(extern_pdf pdf, size_t const& NPDF, T* out);
+      void Convolute(extern_pdf pdf, size_t const& NPDF, T* out, ConvolutionWorkspace<T>& ws);        //!< Convolution reusing a workspace
+      void Convolute(batch_pdf const& pdf, size_t const& NPDF, T* out);
+      void Convolute(batch_pdf const& pdf, size_t const& NPDF, T* out, ConvolutionWorkspace<T>& ws); //!< Batched convolution reusing a workspace
+
+      // ******************** FK Get Methods ***************************
+
+      std::string const& GetDataName()  const {return fDataName;};
+
+      double const&  GetQ20()      const { return fQ20;   }
+
+      int const&   GetNData()   const { return fNData;}  //!< Return fNData
+      int const&   GetNx()      const { return fNx;   }  //!< Return fNx
+      int const&   GetTx()      const { return fTx;   }  //!< Return fTx
+      int const&   GetNB()      const { return fNB;   }  //!< Return fNB
+      int const&   GetNC()      const { return fNC;   }  //!< Return fNC
+      int const&   GetNonZero() const { return fNonZero; }  //!< Return fNonZero
+      bool const&  IsHadronic() const { return fHadronic;}  //!< Return fHadronic
+
+      int  GetNBlocks()  const { return fRowPtr[fNData]; }  //!< Return the number of stored blocks
+      int  GetNCached()  const { return fColumns.size(); }  //!< Return the number of blocks in the PDF cache
+      size_t GetStoredSize() const                          //!< Return the size in bytes of the stored table
+      { return size_t(GetNBlocks())*(fNC*sizeof(T) + sizeof(int)) + (fNData+1)*sizeof(int); }
+
+      const int* GetRowPtr() const { return fRowPtr; }  //!< Return the first block of each datapoint
+      const int* GetCol()    const { return fCol;    }  //!< Return the first x-point index of each block
+      const T*   GetVal()    const { return fVal;    }  //!< Return the block values
+
+    private:
+      FKSparseTable();                                //!< Disable default constructor
+      FKSparseTable(FKSparseTable const&);            //!< Disable copy-construction
+      FKSparseTable& operator=(FKSparseTable const&); //!< Disable copy-assignment
+
+      void ConvoluteEvaluated(const T* evln, size_t const& NPDF, T* out, ConvolutionWorkspace<T>& ws) const; //!< Convolution with evaluated PDFs
+      void CachePDF(const T* evln, size_t const& NPDF, T* pdf) const; // Cache PDF of the stored blocks
+
+      // Metadata
+      const std::string fDataName;
+      const int   fNData;
+      const double  fQ20;
+      const bool  fHadronic;
+      const int   fNonZero;
+      const int   fNx;
+      const int   fTx;
+      FKKernel<T> const& fKernel; //!< Convolution kernel, sets the block width
+      const int   fNB;      //!< x-points per block
+      const int   fNC;      //!< Block width, fNB*fNonZero
+
+      std::vector<int>    fFlmap;
+      std::vector<double> fXgrid;
+
+      // Block-CSR arrays
+      int* fRowPtr;   //!< First block of each datapoint [fNData+1]
+      int* fCol;      //!< First x-point index of each block
+      T*   fVal;      //!< Block values [nblocks][fNC]
+
+      // PDF cache layout
+      std::vector<int> fColumns; //!< First x-point of each block in the PDF cache
+      std::vector<int> fRunPtr;  //!< First run of each datapoint [fNData+1]
+      std::vector<int> fRunSlot; //!< Position in the PDF cache of the first block of each run
+      std::vector<int> fRunLen;  //!< Number of blocks of each run
+  };
+
+  /**
+   * Number of x-points per block of a sparse table, the smallest such that the block
+   * width is a multiple of the kernel width and at least FK_SPARSE_WIDTH
+   */
+  static inline int sparseBlockPoints(int const& nonzero, int const& align)
+  {
+    int g = align, r = nonzero;
+    while (r != 0) { const int t = g % r; g = r; r = t; }
+    const int base = align/g;
+    return base*std::max(1, (FK_SPARSE_WIDTH/base + nonzero - 1)/nonzero);
+  }
+
+  /**
+   * @brief Construct a sparse FK table from a dense one
+   * @param set The dense FK table (including any C-factors)
+   */
+  template<typename T>
+  FKSparseTable<T>::FKSparseTable(FKTable<T> const& set):
+  fDataName(set.GetDataName()),
+  fNData(set.GetNData()),
+  fQ20(set.GetQ20()),
+  fHadronic(set.IsHadronic()),
+  fNonZero(set.GetNonZero()),
+  fNx(set.GetNx()),
+  fTx(set.GetTx()),
+  fKernel(NNPDF::GetKernel<T>()),
+  fNB(sparseBlockPoints(fNonZero, fKernel.align)),
+  fNC(fNB*fNonZero),
+  fFlmap(set.GetFlmap(), set.GetFlmap() + (fHadronic ? 2*fNonZero:fNonZero)),
+  fXgrid(set.GetXGrid(), set.GetXGrid() + fNx),
+  fRowPtr(new int[fNData+1]),
+  fCol(0),
+  fVal(0),
+  fColumns(),
+  fRunPtr(fNData+1, 0),
+  fRunSlot(),
+  fRunLen()
+  {
+    std::vector<T> row(set.IsCompact() ? set.GetDSz():0);
+
+    // Count nonzero blocks, and mark the blocks stored by any datapoint
+    const int nCol = (fTx + fNB - 1)/fNB;
+    std::vector<int> cols;
+    std::vector<int> slot(nCol, -1);
+    fRowPtr[0] = 0;
+    for (int d=0; d<fNData; d++)
+    {
+      const T* sigma = set.GetSigmaRow(d, row.data());
+      for (int c=0; c<nCol; c++)
+      {
+        bool nonzero = false;
+        for (int j=0; j<fNonZero && !nonzero; j++)
+          for (int ab=c*fNB; ab<std::min(fTx, (c+1)*fNB) && !nonzero; ab++)
+            nonzero = sigma[j*fTx + ab] != 0;
+        if (nonzero)
+        {
+          cols.push_back(c*fNB);
+          slot[c] = 0;
+        }
+      }
+      fRowPtr[d+1] = cols.size();
+    }
+
+    // PDF cache positions of the stored blocks
+    for (int c=0; c<nCol; c++)
+      if (slot[c] == 0)
+      {
+        slot[c] = fColumns.size();
+        fColumns.push_back(c*fNB);
+      }
+
+    // Runs of blocks adjacent in the PDF cache
+    for (int d=0; d<fNData; d++)
+    {
+      for (int k=fRowPtr[d]; k<fRowPtr[d+1]; k++)
+      {
+        const int s = slot[cols[k]/fNB];
+        if (k > fRowPtr[d] && s == fRunSlot.back() + fRunLen.back())
+          fRunLen.back()++;
+        else
+        {
+          fRunSlot.push_back(s);
+          fRunLen.push_back(1);
+        }
+      }
+      fRunPtr[d+1] = fRunSlot.size();
+    }
+
+    // Fill blocks, channel-inner, zero beyond the last x-point
+    const int nBlocks = cols.size();
+    fCol = new int[std::max(nBlocks, 1)];
+    fVal = alignedAlloc<T>(size_t(nBlocks)*fNC);
+    std::copy(cols.begin(), cols.end(), fCol);
+
+    for (int d=0; d<fNData; d++)
+    {
+      const T* sigma = set.GetSigmaRow(d, row.data());
+      for (int k=fRowPtr[d]; k<fRowPtr[d+1]; k++)
+      {
+        T* block = fVal + size_t(k)*fNC;
+        for (int p=0; p<fNB; p++)
+          for (int j=0; j<fNonZero; j++)
+            block[p*fNonZero + j] = (fCol[k] + p < fTx) ? sigma[j*fTx + fCol[k] + p]:T(0);
+      }
+    }
+
+    if (Verbose)
+      std::cout << "FKSparseTable: " << fDataName << " stored in " << nBlocks << " of "
+                << size_t(fNData)*nCol << " blocks of " << fNB << " x-points, "
+                << fRunSlot.size() << " runs, " << fColumns.size() << " cached blocks" << std::endl;
+  }
+
+  /**
+   * @brief Construct a sparse FK table from file. The dense table is held only during
+   * construction, and binary tables are mapped rather than read into memory.
+   * @param filename The FK table filename
+   * @param cFactors A vector of filenames for potential C-factors
+   */
+  template<typename T>
+  FKSparseTable<T>::FKSparseTable(std::string const& filename, std::vector<std::string> const& cFactors):
+  FKSparseTable(FKTable<T>(filename, cFactors))
+  {
+  }
+
+  /**
+   * @brief FKSparseTable destructor
+   */
+  template<typename T>
+  FKSparseTable<T>::~FKSparseTable()
+  {
+    delete[] fRowPtr;
+    delete[] fCol;
+    free(fVal);
+  }
+
+  // Perform convolution over the stored blocks
+  template<typename T>
+  void FKSparseTable<T>::Convolute(extern_pdf inpdf, size_t const& Npdf, T* out)
+  {
+    ConvolutionWorkspace<T> ws;
+    Convolute(inpdf, Npdf, out, ws);
+  }
+
+  // Perform convolution over the stored blocks, reusing a workspace
+  template<typename T>
+  void FKSparseTable<T>::Convolute(extern_pdf inpdf, size_t const& Npdf, T* out, ConvolutionWorkspace<T>& ws)
+  {
+    ConvoluteEvaluated(ws.EvaluatePDF(inpdf, &fXgrid[0], fNx, sqrt(fQ20), Npdf), Npdf, out, ws);
+  }
+
+  // Perform convolution over the stored blocks with a batched PDF callback
+  template<typename T>
+  void FKSparseTable<T>::Convolute(batch_pdf const& inpdf, size_t const& Npdf, T* out)
+  {
+    ConvolutionWorkspace<T> ws;
+    Convolute(inpdf, Npdf, out, ws);
+  }
+
+  // Perform convolution over the stored blocks with a batched PDF callback, reusing a workspace
+  template<typename T>
+  void FKSparseTable<T>::Convolute(batch_pdf const& inpdf, size_t const& Npdf, T* out, ConvolutionWorkspace<T>& ws)
+  {
+    ConvoluteEvaluated(ws.EvaluatePDF(inpdf, &fXgrid[0], fNx, sqrt(fQ20), Npdf), Npdf, out, ws);
+  }
+
+  // Perform convolution with evolution-basis PDFs evaluated on the x-grid, [member][x][14]
+  template<typename T>
+  void FKSparseTable<T>::ConvoluteEvaluated(const T* evln, size_t const& Npdf, T* out, ConvolutionWorkspace<T>& ws) const
+  {
+    // PDF cache of the stored blocks
+    const size_t Psz = fColumns.size()*fNC;
+    T *pdf = ws.Scratch(0, Psz*Npdf);
+    CachePDF(evln, Npdf, pdf);
+
+    // Calculate observables, one dot product per run of adjacent blocks
+#if APFELGRID_HAVE_OMP == 1
+#pragma omp parallel for schedule(dynamic)
+#endif
+    for (int i = 0; i < fNData; i++)
+      for (size_t n = 0; n < Npdf; n++)
+      {
+        const T* npdf = pdf + n*Psz;
+        const T* val = fVal + size_t(fRowPtr[i])*fNC;
+        T result = 0;
+        for (int r = fRunPtr[i]; r < fRunPtr[i+1]; r++)
+        {
+          const int len = fRunLen[r]*fNC;
+          T run = 0;
+          fKernel.dot(npdf + size_t(fRunSlot[r])*fNC, val, run, len);
+          result += run;
+          val += len;
+        }
+        out[i*Npdf + n] = result;
+      }
+
+    return;
+  }
+
+  // Cache PDF of the stored blocks, zero beyond the last x-point
+  template<typename T>
+  void FKSparseTable<T>::CachePDF(const T* evln, size_t const& NPDF, T* pdf) const
+  {
+    const int NFL = 14;
+    const int nCols = fColumns.size();
+
+    for (size_t n = 0; n < NPDF; n++)
+    {
+      const T* EVLN = evln + n*fNx*NFL;
+      for (int s = 0; s < nCols; s++)
+        for (int p = 0; p < fNB; p++)
+        {
+          T* block = pdf + (n*nCols + s)*fNC + p*fNonZero;
+          const int ab = fColumns[s] + p;
+          if (ab >= fTx)
+            std::fill(block, block + fNonZero, T(0));
+          else if (fHadronic)
+          {
+            const int a = ab / fNx;
+            const int b = ab % fNx;
+            for (int fl = 0; fl < fNonZero; fl++)
+              block[fl] = EVLN[a*NFL+fFlmap[2*fl]]*EVLN[b*NFL+fFlmap[2*fl+1]];
+          }
+          else
+          {
+            for (int fl = 0; fl < fNonZero; fl++)
+              block[fl] = EVLN[ab*NFL+fFlmap[fl]];
+          }
+        }
+    }
+  }
+}
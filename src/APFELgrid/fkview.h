@@ -0,0 +1,233 @@
+// The MIT License (MIT)
+
+// Copyright (c) Stefano Carrazza, Luigi Del Debbio, Nathan Hartland
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+#include "fastkernel.h"
+
+namespace NNPDF
+{
+ /**
+  * \class FKTableView
+  * \brief Masked view of an FK table, sharing the table's sigma block
+  *
+  * A view holds the indices of its datapoints in the table, such that building it costs
+  * O(mask size) rather than a copy of the selected rows. Views built from an FKTable share
+  * its sigma block through a lightweight copy of the table metadata; views built from a
+  * shared table, or from another view, share the table itself. The view's own C-factors
+  * are applied to its convolution, in addition to those already in the table.
+  * A contiguous FKTable of the selected datapoints is only made on request by Compact().
+  */
+  template<typename T>
+  class FKTableView
+  {
+    public:
+      typedef typename FKTable<T>::extern_pdf extern_pdf;
+      typedef typename FKTable<T>::batch_pdf  batch_pdf;
+
+      FKTableView(FKTable<T> const& table, std::vector<int> const& mask,
+                  std::vector<std::string> const& cFactors = std::vector<std::string>()); //!< View sharing the sigma block of table
+      FKTableView(std::shared_ptr<const FKTable<T> > const& table, std::vector<int> const& mask,
+                  std::vector<std::string> const& cFactors = std::vector<std::string>()); //!< View sharing table
+      FKTableView(FKTableView const& view, std::vector<int> const& mask);                 //!< View of a subset of view
+
+      void Convolute(extern_pdf pdf, size_t const& NPDF, T* out);
+      void Convolute(extern_pdf pdf, size_t const& NPDF, T* out, ConvolutionWorkspace<T>& ws); //!< Convolution reusing a workspace
+      void Convolute(batch_pdf const& pdf, size_t const& NPDF, T* out);
+      void Convolute(batch_pdf const& pdf, size_t const& NPDF, T* out, ConvolutionWorkspace<T>& ws);
+
+      FKTable<T>* Compact() const; //!< Return a new FK table holding a contiguous copy of the selected datapoints
+
+      void SetConvolutionMode(FKConvolutionMode mode) { fMode = mode; } //!< Set the strategy used by Convolute
+      FKConvolutionMode GetConvolutionMode() const { return fMode; }   //!< Return the strategy used by Convolute
+
+      // ******************** FKTableView Get Methods ***************************
+
+      int GetNData() const { return fMask.size(); }                  //!< Return the number of selected datapoints
+      std::vector<int> const& GetMask() const { return fMask; }      //!< Return the datapoints of the table in the view
+      double const* GetCFactors() const { return &fcFactors[0]; }    //!< Return the C-factors, including those of the table
+      FKTable<T> const& GetTable() const { return *fTable; }         //!< Return the underlying table
+
+    private:
+      FKTableView();                              //!< Disable default constructor
+      FKTableView& operator=(FKTableView const&); //!< Disable copy-assignment
+
+      void Initialise(std::vector<std::string> const& cFactors); //!< Check the mask and read the view C-factors
+      void ConvoluteEvaluated(const T* evln, size_t const& NPDF, T* out, ConvolutionWorkspace<T>& ws); //!< Convolution with evaluated PDFs
+
+      const std::shared_ptr<const FKTable<T> > fTable;
+      std::vector<int> fMask;        //!< Datapoints of the table in the view
+      std::vector<double> fScale;    //!< C-factors of the view, empty if none
+      std::vector<double> fcFactors; //!< C-factors of the table and view
+      FKConvolutionMode fMode;
+  };
+
+  /**
+   * @brief FKTableView constructor, sharing the sigma block of table
+   * @param table The FK table, which need not outlive the view
+   * @param mask The datapoints of table in the view
+   * @param cFactors A vector of filenames for C-factors of the view, over all datapoints of table
+   */
+  template<typename T>
+  FKTableView<T>::FKTableView(FKTable<T> const& table, std::vector<int> const& mask, std::vector<std::string> const& cFactors):
+  fTable(new FKTable<T>(table, table.fSigmaStore)),
+  fMask(mask),
+  fScale(),
+  fcFactors(),
+  fMode(table.fMode)
+  {
+    Initialise(cFactors);
+  }
+
+  /**
+   * @brief FKTableView constructor, sharing table
+   * @param table The FK table
+   * @param mask The datapoints of table in the view
+   * @param cFactors A vector of filenames for C-factors of the view, over all datapoints of table
+   */
+  template<typename T>
+  FKTableView<T>::FKTableView(std::shared_ptr<const FKTable<T> > const& table, std::vector<int> const& mask, std::vector<std::string> const& cFactors):
+  fTable(table),
+  fMask(mask),
+  fScale(),
+  fcFactors(),
+  fMode(table->fMode)
+  {
+    Initialise(cFactors);
+  }
+
+  /**
+   * @brief FKTableView constructor, for a subset of a view
+   * @param view The parent view
+   * @param mask The datapoints of view in the new view
+   */
+  template<typename T>
+  FKTableView<T>::FKTableView(FKTableView const& view, std::vector<int> const& mask):
+  fTable(view.fTable),
+  fMask(mask.size()),
+  fScale(),
+  fcFactors(),
+  fMode(view.fMode)
+  {
+    for (size_t i=0; i<mask.size(); i++)
+    {
+      if (mask[i] < 0 || mask[i] >= view.GetNData())
+        throw std::runtime_error("FKTableView::FKTableView mask index out of range: " + ToString(mask[i]));
+      fMask[i] = view.fMask[mask[i]];
+      if (!view.fScale.empty())
+        fScale.push_back(view.fScale[mask[i]]);
+    }
+    Initialise(std::vector<std::string>());
+  }
+
+  template<typename T>
+  void FKTableView<T>::Initialise(std::vector<std::string> const& cFactors)
+  {
+    const int ndata = fTable->GetNData();
+    if (fMask.size() == 0)
+      throw std::runtime_error("FKTableView::FKTableView datapoints cut to 0!");
+
+    for (size_t i=0; i<fMask.size(); i++)
+      if (fMask[i] < 0 || fMask[i] >= ndata)
+        throw std::runtime_error("FKTableView::FKTableView mask index out of range: " + ToString(fMask[i]));
+
+    // C-factors of the view, read over all datapoints of the table
+    if (cFactors.size() > 0)
+    {
+      std::vector<double> cf(ndata, 1.0);
+      for (size_t i=0; i<cFactors.size(); i++)
+        readCFactors<T>(cFactors[i], ndata, &cf[0]);
+      for (size_t i=0; i<fMask.size(); i++)
+        fScale.push_back(cf[fMask[i]]);
+    }
+
+    fcFactors.resize(fMask.size());
+    for (size_t i=0; i<fMask.size(); i++)
+      fcFactors[i] = fTable->GetCFactors()[fMask[i]]*(fScale.empty() ? 1.0:fScale[i]);
+  }
+
+  // Perform convolution
+  template<typename T>
+  void FKTableView<T>::Convolute(extern_pdf pdf, size_t const& NPDF, T* out)
+  {
+    ConvolutionWorkspace<T> ws;
+    Convolute(pdf, NPDF, out, ws);
+  }
+
+  // Perform convolution, reusing a workspace
+  template<typename T>
+  void FKTableView<T>::Convolute(extern_pdf pdf, size_t const& NPDF, T* out, ConvolutionWorkspace<T>& ws)
+  {
+    ConvoluteEvaluated(ws.EvaluatePDF(pdf, fTable->fXgrid, fTable->fNx, sqrt(fTable->fQ20), NPDF), NPDF, out, ws);
+  }
+
+  // Perform convolution with a batched PDF callback
+  template<typename T>
+  void FKTableView<T>::Convolute(batch_pdf const& pdf, size_t const& NPDF, T* out)
+  {
+    ConvolutionWorkspace<T> ws;
+    Convolute(pdf, NPDF, out, ws);
+  }
+
+  // Perform convolution with a batched PDF callback, reusing a workspace
+  template<typename T>
+  void FKTableView<T>::Convolute(batch_pdf const& pdf, size_t const& NPDF, T* out, ConvolutionWorkspace<T>& ws)
+  {
+    ConvoluteEvaluated(ws.EvaluatePDF(pdf, fTable->fXgrid, fTable->fNx, sqrt(fTable->fQ20), NPDF), NPDF, out, ws);
+  }
+
+  // Perform convolution of the selected datapoints only
+  template<typename T>
+  void FKTableView<T>::ConvoluteEvaluated(const T* evln, size_t const& NPDF, T* out, ConvolutionWorkspace<T>& ws)
+  {
+    fTable->ConvoluteRows(evln, NPDF, out, ws, fMode, &fMask[0], fMask.size());
+
+    if (!fScale.empty())
+      for (size_t i=0; i<fMask.size(); i++)
+        for (size_t n=0; n<NPDF; n++)
+          out[i*NPDF + n] *= fScale[i];
+  }
+
+  /**
+   * @brief Contiguous copy of the selected datapoints, with the C-factors of the view
+   * applied, identical to the masked copy of the table.
+   */
+  template<typename T>
+  FKTable<T>* FKTableView<T>::Compact() const
+  {
+    FKTable<T>* fk = new FKTable<T>(*fTable, fMask);
+    if (!fScale.empty())
+      for (int i=0; i<fk->fNData; i++)
+      {
+        T* sig = fk->fSigma + size_t(i)*fk->fDSz;
+        for (int j=0; j<fk->fDSz; j++)
+          sig[j] *= fScale[i];
+        fk->fcFactors[i] *= fScale[i];
+      }
+    fk->fMode = fMode;
+    if (fTable->IsCompact())
+      fk->CompactBoxes();
+    return fk;
+  }
+
+}
@@ -0,0 +1,216 @@
+// The MIT License (MIT)
+
+// Copyright (c) Stefano Carrazza, Luigi Del Debbio, Nathan Hartland
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <deque>
+#include <algorithm>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <condition_variable>
+
+namespace NNPDF
+{
+ /**
+  * \class ThreadPool
+  * \brief Work-stealing thread pool for batches of independent tasks
+  *
+  * Run() distributes the tasks of a batch round-robin over one queue per thread. Each
+  * thread takes tasks from the back of its own queue and, once it is empty, steals from
+  * the front of the others. The calling thread takes part as thread 0, so a pool of
+  * one thread runs tasks serially without starting any threads.
+  */
+  class ThreadPool
+  {
+    public:
+      typedef std::function<void()> Task;
+
+      explicit ThreadPool(int const& nthreads = 0); //!< Pool of nthreads threads, 0 for the hardware concurrency
+      ~ThreadPool();
+
+      void Run(std::vector<Task> const& tasks); //!< Run a batch of tasks, returning once all are complete
+
+      int GetNThreads() const { return fNThreads; } //!< Return the number of threads, including the caller
+
+    private:
+      ThreadPool(ThreadPool const&);            //!< Disable copy-construction
+      ThreadPool& operator=(ThreadPool const&); //!< Disable copy-assignment
+
+      struct Queue
+      {
+        std::mutex lock;
+        std::deque<size_t> items;
+      };
+
+      void Worker(int const& id);  //!< Thread main loop
+      void Work(int const& id);    //!< Run tasks until no queue has any left
+      bool Next(int const& id, size_t& task); //!< Take a task, stealing if the own queue is empty
+
+      const int fNThreads;
+      std::vector<std::thread> fThreads;
+      std::vector<Queue*> fQueues;
+
+      std::mutex fLock;                   //!< Guards the batch state below
+      std::condition_variable fWake;      //!< Signals a new batch or shutdown
+      std::condition_variable fDone;      //!< Signals completion of a batch
+      std::mutex fRunLock;                //!< Serialises calls to Run
+
+      const std::vector<Task>* fTasks;    //!< Current batch
+      std::atomic<size_t> fPending;       //!< Tasks of the current batch not yet complete
+      size_t fBatch;                      //!< Batch counter
+      bool fStop;
+      std::exception_ptr fError;          //!< First exception thrown by a task of the batch
+  };
+
+  inline ThreadPool::ThreadPool(int const& nthreads):
+  fNThreads(nthreads > 0 ? nthreads:std::max(1, (int) std::thread::hardware_concurrency())),
+  fThreads(),
+  fQueues(),
+  fTasks(NULL),
+  fPending(0),
+  fBatch(0),
+  fStop(false),
+  fError()
+  {
+    for (int i=0; i<fNThreads; i++)
+      fQueues.push_back(new Queue());
+    for (int i=1; i<fNThreads; i++)
+      fThreads.push_back(std::thread(&ThreadPool::Worker, this, i));
+  }
+
+  inline ThreadPool::~ThreadPool()
+  {
+    {
+      std::lock_guard<std::mutex> guard(fLock);
+      fStop = true;
+    }
+    fWake.notify_all();
+    for (size_t i=0; i<fThreads.size(); i++)
+      fThreads[i].join();
+    for (size_t i=0; i<fQueues.size(); i++)
+      delete fQueues[i];
+  }
+
+  inline void ThreadPool::Run(std::vector<Task> const& tasks)
+  {
+    if (tasks.size() == 0)
+      return;
+
+    std::lock_guard<std::mutex> run(fRunLock);
+    {
+      std::lock_guard<std::mutex> guard(fLock);
+      fTasks = &tasks;
+      fError = std::exception_ptr();
+      fPending = tasks.size();
+      for (size_t t=0; t<tasks.size(); t++)
+      {
+        Queue* q = fQueues[t % fNThreads];
+        std::lock_guard<std::mutex> qguard(q->lock);
+        q->items.push_back(t);
+      }
+      fBatch++;
+    }
+    fWake.notify_all();
+
+    // The caller works as thread 0
+    Work(0);
+
+    std::unique_lock<std::mutex> guard(fLock);
+    while (fPending > 0)
+      fDone.wait(guard);
+    fTasks = NULL;
+
+    if (fError)
+      std::rethrow_exception(fError);
+  }
+
+  inline void ThreadPool::Worker(int const& id)
+  {
+    size_t batch = 0;
+    while (true)
+    {
+      {
+        std::unique_lock<std::mutex> guard(fLock);
+        while (!fStop && batch == fBatch)
+          fWake.wait(guard);
+        if (fStop)
+          return;
+        batch = fBatch;
+      }
+      Work(id);
+    }
+  }
+
+  inline void ThreadPool::Work(int const& id)
+  {
+    size_t task;
+    while (Next(id, task))
+    {
+      try
+      {
+        (*fTasks)[task]();
+      }
+      catch (...)
+      {
+        std::lock_guard<std::mutex> guard(fLock);
+        if (!fError)
+          fError = std::current_exception();
+      }
+
+      if (--fPending == 0)
+      {
+        std::lock_guard<std::mutex> guard(fLock);
+        fDone.notify_all();
+      }
+    }
+  }
+
+  inline bool ThreadPool::Next(int const& id, size_t& task)
+  {
+    for (int i=0; i<fNThreads; i++)
+    {
+      Queue* q = fQueues[(id + i) % fNThreads];
+      std::lock_guard<std::mutex> guard(q->lock);
+      if (q->items.empty())
+        continue;
+
+      // Own queue from the back, others from the front
+      if (i == 0)
+      {
+        task = q->items.back();
+        q->items.pop_back();
+      }
+      else
+      {
+        task = q->items.front();
+        q->items.pop_front();
+      }
+      return true;
+    }
+    return false;
+  }
+
+}
@@ -1,5 +1,7 @@
 //transform.h
 
+#include <algorithm>
+
 namespace NNPDF
 {
     // LHA-style flavour basis
@@ -53,4 +55,67 @@ namespace NNPDF
     EVLN[13]=( uplus + dplus + splus + cplus + bplus - 5*tplus ); // T35
   }
 
+  /**
+   * Rotate a block of flavour basis PDFs to evolution basis. Points are transposed in
+   * groups of eight such that each combination is computed for all points of a group
+   * at once, with the same arithmetic as the single-point LHA2EVLN.
+   * \param nx the number of points
+   * \param LHA the les houches pdfs, [nx][ldLHA]. ldLHA is 13 for the usual
+   *  tbar..t array (the photon is then zero), or 14 to include the photon
+   * \param ldLHA the stride of LHA
+   * \return EVLN the lha in the evln basis, [nx][14]
+   */
+  template<class inType, class outType>
+  void LHA2EVLN(int const& nx, const inType *LHA, int const& ldLHA, outType *EVLN)
+  {
+    const int NB = 8;
+    for (int i0 = 0; i0 < nx; i0 += NB)
+    {
+      const int nb = std::min(NB, nx - i0);
+      inType lha[14][NB];
+      outType evln[14][NB];
+
+      for (int i = 0; i < NB; i++)
+        for (int fl = 0; fl < 14; fl++)
+          lha[fl][i] = (i < nb && fl < ldLHA) ? LHA[(i0+i)*ldLHA + fl] : 0;
+
+      for (int i = 0; i < NB; i++)
+      {
+        const outType uplus  = lha[U][i] + lha[UBAR][i];
+        const outType uminus = lha[U][i] - lha[UBAR][i];
+        const outType dplus  = lha[D][i] + lha[DBAR][i];
+        const outType dminus = lha[D][i] - lha[DBAR][i];
+        const outType cplus  = lha[C][i] + lha[CBAR][i];
+        const outType cminus = lha[C][i] - lha[CBAR][i];
+        const outType splus  = lha[S][i] + lha[SBAR][i];
+        const outType sminus = lha[S][i] - lha[SBAR][i];
+        const outType tplus  = lha[T][i] + lha[TBAR][i];
+        const outType tminus = lha[T][i] - lha[TBAR][i];
+        const outType bplus  = lha[B][i] + lha[BBAR][i];
+        const outType bminus = lha[B][i] - lha[BBAR][i];
+
+        evln[0][i]  = lha[PHT][i]; // photon
+        evln[1][i]  = (uplus + dplus + cplus + splus + tplus + bplus); //Singlet
+        evln[2][i]  = (lha[GLUON][i]); // Gluon
+
+        evln[3][i]  = ( uminus + dminus + sminus + cminus + bminus + tminus ); //V
+        evln[4][i]  = ( uminus - dminus ); // V3
+        evln[5][i]  = ( uminus + dminus - 2*sminus); // V8
+        evln[6][i]  = ( uminus + dminus + sminus - 3*cminus); //V15
+        evln[7][i]  = ( uminus + dminus + sminus + cminus - 4*bminus ); //V24
+        evln[8][i]  = ( uminus + dminus + sminus + cminus + bminus - 5*tminus); // V35
+
+        evln[9][i]  = (  uplus - dplus ); // T3
+        evln[10][i] = ( uplus + dplus - 2*splus ); // T8
+        evln[11][i] = ( uplus + dplus + splus - 3*cplus ); //T15
+        evln[12][i] = ( uplus + dplus + splus + cplus - 4*bplus ); //T24
+        evln[13][i] = ( uplus + dplus + splus + cplus + bplus - 5*tplus ); // T35
+      }
+
+      for (int i = 0; i < nb; i++)
+        for (int fl = 0; fl < 14; fl++)
+          EVLN[(i0+i)*14 + fl] = evln[fl][i];
+    }
+  }
+
 }
\ No newline at end of file
@@ -0,0 +1,414 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016 Nathan Hartland
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// fkbench: benchmarks of the FK table driver on synthetic tables, without external
+// dependencies. DIS and hadronic tables of configurable size, flavour content and
+// sparsity are generated, and the load (plaintext, gzip, binary and shared memory),
+// PDF luminosity, convolution and printing times are measured in both precisions,
+// with an analytic toy PDF. Results are written as JSON.
+
+#include "APFELgrid/fastkernel.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+#include <sys/stat.h>
+#if APFELGRID_HAVE_OMP == 1
+#include <omp.h>
+#endif
+
+// Benchmark configuration
+struct BenchConfig
+{
+  bool hadronic;
+  int nx;
+  int ndata;
+  int nchannels;     // Active flavour channels, of 196 (hadronic) or 14 (DIS)
+  double sparsity;   // Fraction of empty (x1, x2) or x rows
+  unsigned seed;
+};
+
+// One timing
+struct BenchResult
+{
+  std::string table, stage, format, precision, mode;
+  size_t npdf;
+  double seconds;
+  double bytes;      // Memory or file traffic
+  double flops;      // Floating point operations, excluding padding
+};
+
+// Analytic toy PDF, varying with the member index
+template<typename T>
+void toyPDF(const double& x, const double&, const size_t& n, T* pdf)
+{
+  for (int fl = 0; fl < 14; fl++)
+    pdf[fl] = std::pow(x, -0.1*(fl%5))*std::pow(1.0 - x, 3 + fl%3)*(1.0 + 0.01*n);
+}
+
+// Best time in seconds of repeat calls
+template<class F>
+double timeBest(int const& repeat, F f)
+{
+  double best = 1e300;
+  for (int r = 0; r < repeat; r++)
+  {
+    const std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+    f();
+    best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count());
+  }
+  return best;
+}
+
+// Stream buffer discarding its output, counting the bytes written
+class CountingBuffer : public std::streambuf
+{
+  public:
+    CountingBuffer(): fCount(0) {}
+    size_t GetCount() const { return fCount; }
+  protected:
+    int_type overflow(int_type c) { fCount++; return c; }
+    std::streamsize xsputn(const char*, std::streamsize n) { fCount += n; return n; }
+  private:
+    size_t fCount;
+};
+
+size_t fileSize(std::string const& filename)
+{
+  struct stat st;
+  return stat(filename.c_str(), &st) == 0 ? st.st_size:0;
+}
+
+// Write a synthetic plaintext FK table
+void generateTable(BenchConfig const& c, std::string const& name, std::string const& filename)
+{
+  const int nFL = 14;
+  const int ncol = c.hadronic ? nFL*nFL:nFL;
+  if (c.nchannels < 1 || c.nchannels > ncol)
+    throw std::runtime_error("fkbench invalid number of channels: " + NNPDF::ToString(c.nchannels));
+
+  std::mt19937 rng(c.seed);
+  std::uniform_real_distribution<double> uniform(0.0, 1.0);
+
+  // Active channels
+  std::vector<int> channels(ncol);
+  for (int i = 0; i < ncol; i++) channels[i] = i;
+  std::shuffle(channels.begin(), channels.end(), rng);
+  std::vector<bool> active(ncol, false);
+  for (int i = 0; i < c.nchannels; i++) active[channels[i]] = true;
+
+  NNPDF::FKHeader head;
+  head.AddTag(NNPDF::FKHeader::BLOB, "GridDesc", "fkbench synthetic table");
+  head.AddTag(NNPDF::FKHeader::VERSIONS, "FKBENCH", "1");
+  head.AddTag(NNPDF::FKHeader::GRIDINFO, "SETNAME", name);
+  head.AddTag(NNPDF::FKHeader::GRIDINFO, "NDATA", c.ndata);
+  head.AddTag(NNPDF::FKHeader::GRIDINFO, "HADRONIC", c.hadronic);
+  head.AddTag(NNPDF::FKHeader::GRIDINFO, "NX", c.nx);
+  head.AddTag(NNPDF::FKHeader::THEORYINFO, "Q0", 1.65);
+
+  std::stringstream xgrid;
+  for (int i = 0; i < c.nx; i++)
+    xgrid << std::setprecision(16) << std::scientific << 1e-5*std::pow(1e5, i/(c.nx - 1.0)) << std::endl;
+  head.AddTag(NNPDF::FKHeader::BLOB, "xGrid", xgrid.str());
+
+  std::stringstream flmap;
+  for (int i = 0; i < ncol; i++)
+    flmap << (active[i] ? "1 ":"0 ") << ((i+1)%nFL == 0 ? "\n":"");
+  head.AddTag(NNPDF::FKHeader::BLOB, "FlavourMap", flmap.str());
+
+  std::ofstream os(filename.c_str());
+  head.Print(os); // Ends with the FastKernel section header
+
+  char val[32];
+  const int nrow = c.hadronic ? c.nx*c.nx:c.nx;
+  for (int d = 0; d < c.ndata; d++)
+    for (int r = 0; r < nrow; r++)
+    {
+      if (uniform(rng) < c.sparsity)
+        continue;
+      os << d << '\t' << (c.hadronic ? r/c.nx:r) << '\t';
+      if (c.hadronic) os << r%c.nx << '\t';
+      for (int k = 0; k < ncol; k++)
+      {
+        if (active[k])
+        {
+          snprintf(val, sizeof(val), "%.16e", 2*uniform(rng) - 1);
+          os << val << '\t';
+        }
+        else
+          os << "0\t";
+      }
+      os << '\n';
+    }
+
+  if (!os.good())
+    throw std::runtime_error("fkbench cannot write table: " + filename);
+}
+
+#if APFELGRID_HAVE_ZLIB == 1
+// Compress a file with gzip
+void compressTable(std::string const& infile, std::string const& outfile)
+{
+  std::ifstream is(infile.c_str(), std::ios::binary);
+  gzFile gz = gzopen(outfile.c_str(), "wb6");
+  if (gz == NULL)
+    throw std::runtime_error("fkbench cannot write table: " + outfile);
+  std::vector<char> buf(1 << 20);
+  while (is.read(&buf[0], buf.size()) || is.gcount() > 0)
+    gzwrite(gz, &buf[0], is.gcount());
+  gzclose(gz);
+}
+#endif
+
+// Benchmarks of one table in precision T
+template<typename T>
+void benchTable(std::string const& table, std::string const& base, std::vector<size_t> const& npdfs,
+                int const& repeat, std::vector<BenchResult>& results)
+{
+  const std::string prec = sizeof(T) == sizeof(double) ? "double":"float";
+  const std::string text = base + ".fk";
+  const std::string binary = base + "_" + prec + ".fkb";
+  const BenchResult proto = {table, "", "", prec, "", 0, 0, 0, 0};
+
+  // Loading
+  std::vector<std::string> formats(1, "text"), files(1, text);
+#if APFELGRID_HAVE_ZLIB == 1
+  formats.push_back("gzip");
+  files.push_back(text + ".gz");
+#endif
+  {
+    NNPDF::FKTable<T> FK(text);
+    std::ofstream os(binary.c_str(), std::ios::out | std::ios::binary);
+    FK.PrintBinary(os);
+  }
+  formats.push_back("binary");
+  files.push_back(binary);
+
+  for (size_t f = 0; f < formats.size(); f++)
+  {
+    BenchResult r = proto;
+    r.stage = "load"; r.format = formats[f];
+    r.seconds = timeBest(repeat, [&]() { NNPDF::FKTable<T> FK(files[f]); });
+    r.bytes = fileSize(files[f]);
+    results.push_back(r);
+  }
+
+  // Attaching to a table already in shared memory
+  {
+    NNPDF::FKTable<T> holder(binary, std::vector<std::string>(), NNPDF::FK_SHARED);
+    BenchResult r = proto;
+    r.stage = "load"; r.format = "shared";
+    r.seconds = timeBest(repeat, [&]() { NNPDF::FKTable<T> FK(binary, std::vector<std::string>(), NNPDF::FK_SHARED); });
+    r.bytes = fileSize(binary);
+    results.push_back(r);
+  }
+
+  NNPDF::FKTable<T> FK(binary);
+  const double sigmaBytes = double(FK.GetDSz())*FK.GetNData()*sizeof(T);
+  const double elements = double(FK.GetTx())*FK.GetNonZero();
+
+  // PDF luminosity and convolution
+  static const NNPDF::FKConvolutionMode modes[] = {NNPDF::FK_LUMINOSITY, NNPDF::FK_FACTORISED, NNPDF::FK_BOXED};
+  static const char* modeNames[] = {"luminosity", "factorised", "boxed"};
+  for (size_t i = 0; i < npdfs.size(); i++)
+  {
+    const size_t npdf = npdfs[i];
+    NNPDF::ConvolutionWorkspace<T> ws;
+    const T* evln = ws.EvaluatePDF(toyPDF<T>, FK.GetXGrid(), FK.GetNx(), sqrt(FK.GetQ20()), npdf);
+
+    T* lumi = NNPDF::alignedAlloc<T>(size_t(FK.GetDSz())*npdf);
+    BenchResult r = proto;
+    r.stage = "cachepdf"; r.npdf = npdf;
+    r.seconds = timeBest(repeat, [&]() { NNPDF::cacheLuminosity(evln, npdf, FK.GetNx(), FK.GetTx(), FK.GetNonZero(), FK.GetFlmap(),
+                                                                 FK.IsHadronic(), FK.GetDSz(), lumi); });
+    r.bytes = double(FK.GetDSz())*npdf*sizeof(T);
+    r.flops = FK.IsHadronic() ? elements*npdf:0;
+    results.push_back(r);
+    free(lumi);
+
+    std::vector<T> out(size_t(FK.GetNData())*npdf);
+    for (int m = 0; m < 3; m++)
+    {
+      FK.SetConvolutionMode(modes[m]);
+      FK.Convolute(toyPDF<T>, npdf, &out[0], ws); // PDFs are evaluated once, outside the timing
+      r.stage = "convolute"; r.mode = modeNames[m];
+      r.seconds = timeBest(repeat, [&]() { FK.Convolute(toyPDF<T>, npdf, &out[0], ws); });
+      r.bytes = sigmaBytes + double(FK.GetDSz())*npdf*sizeof(T);
+      r.flops = 2*elements*FK.GetNData()*npdf;
+      results.push_back(r);
+    }
+  }
+
+  // Printing
+  {
+    BenchResult r = proto;
+    CountingBuffer buf;
+    r.stage = "print"; r.format = "text";
+    r.seconds = timeBest(repeat, [&]() { std::ostream os(&buf); FK.Print(os); });
+    r.bytes = buf.GetCount()/repeat;
+    results.push_back(r);
+  }
+
+  remove(binary.c_str());
+}
+
+void writeJSON(std::ostream& os, std::vector<BenchConfig> const& configs, std::vector<BenchResult> const& results, int const& repeat)
+{
+  int threads = 1;
+#if APFELGRID_HAVE_OMP == 1
+  threads = omp_get_max_threads();
+#endif
+  os << "{" << std::endl;
+  os << "  \"benchmark\": \"fkbench\"," << std::endl;
+  os << "  \"kernel\": {\"float\": \"" << NNPDF::GetKernel<float>().name << "\", \"double\": \"" << NNPDF::GetKernel<double>().name << "\"}," << std::endl;
+  os << "  \"threads\": " << threads << "," << std::endl;
+  os << "  \"repeat\": " << repeat << "," << std::endl;
+  os << "  \"tables\": [" << std::endl;
+  for (size_t i = 0; i < configs.size(); i++)
+    os << "    {\"name\": \"" << (configs[i].hadronic ? "hadronic":"dis") << "\", \"nx\": " << configs[i].nx
+       << ", \"ndata\": " << configs[i].ndata << ", \"channels\": " << configs[i].nchannels
+       << ", \"sparsity\": " << configs[i].sparsity << ", \"seed\": " << configs[i].seed << "}"
+       << (i + 1 < configs.size() ? ",":"") << std::endl;
+  os << "  ]," << std::endl;
+  os << "  \"results\": [" << std::endl;
+  for (size_t i = 0; i < results.size(); i++)
+  {
+    BenchResult const& r = results[i];
+    os << "    {\"table\": \"" << r.table << "\", \"stage\": \"" << r.stage << "\", \"precision\": \"" << r.precision << "\"";
+    if (!r.format.empty()) os << ", \"format\": \"" << r.format << "\"";
+    if (!r.mode.empty())   os << ", \"mode\": \"" << r.mode << "\"";
+    if (r.npdf > 0)        os << ", \"npdf\": " << r.npdf;
+    os << ", \"seconds\": " << r.seconds << ", \"bytes\": " << r.bytes
+       << ", \"GB/s\": " << r.bytes/r.seconds/1e9 << ", \"GFLOP/s\": " << r.flops/r.seconds/1e9 << "}"
+       << (i + 1 < results.size() ? ",":"") << std::endl;
+  }
+  os << "  ]" << std::endl;
+  os << "}" << std::endl;
+}
+
+void usage(const char* prog)
+{
+  std::cerr << "Usage: " << prog << " [options]" << std::endl;
+  std::cerr << "  -t had|dis|both  tables to benchmark (both)" << std::endl;
+  std::cerr << "  -x NX            x-grid points, hadronic/DIS (30/50)" << std::endl;
+  std::cerr << "  -d NDATA         datapoints, hadronic/DIS (50/500)" << std::endl;
+  std::cerr << "  -c NCHANNELS     active flavour channels, hadronic/DIS (40/9)" << std::endl;
+  std::cerr << "  -s SPARSITY      fraction of empty rows (0.5)" << std::endl;
+  std::cerr << "  -n N1,N2,...     numbers of PDF members (1,10,100)" << std::endl;
+  std::cerr << "  -r REPEAT        repetitions of each timing, the best is kept (3)" << std::endl;
+  std::cerr << "  -S SEED          random seed (1)" << std::endl;
+  std::cerr << "  -w DIR           directory for the generated tables (.)" << std::endl;
+  std::cerr << "  -o FILE          JSON output (fkbench.json)" << std::endl;
+  exit(-1);
+}
+
+int main(int argc, char* argv[])
+{
+  std::string tables = "both", dir = ".", output = "fkbench.json";
+  int nx = 0, ndata = 0, nchannels = 0, repeat = 3;
+  double sparsity = 0.5;
+  unsigned seed = 1;
+  std::vector<size_t> npdfs;
+
+  for (int i = 1; i < argc; i++)
+  {
+    const std::string opt = argv[i];
+    if (opt.size() != 2 || opt[0] != '-' || i + 1 == argc)
+      usage(argv[0]);
+    const std::string val = argv[++i];
+    switch (opt[1])
+    {
+      case 't': tables = val; break;
+      case 'x': nx = atoi(val.c_str()); break;
+      case 'd': ndata = atoi(val.c_str()); break;
+      case 'c': nchannels = atoi(val.c_str()); break;
+      case 's': sparsity = atof(val.c_str()); break;
+      case 'r': repeat = std::max(1, atoi(val.c_str())); break;
+      case 'S': seed = atoi(val.c_str()); break;
+      case 'w': dir = val; break;
+      case 'o': output = val; break;
+      case 'n':
+      {
+        std::stringstream ss(val);
+        std::string n;
+        while (std::getline(ss, n, ','))
+          npdfs.push_back(atoi(n.c_str()));
+        break;
+      }
+      default: usage(argv[0]);
+    }
+  }
+  if (tables != "both" && tables != "had" && tables != "dis")
+    usage(argv[0]);
+  if (npdfs.empty())
+  {
+    npdfs.push_back(1);
+    npdfs.push_back(10);
+    npdfs.push_back(100);
+  }
+
+  std::vector<BenchConfig> configs;
+  if (tables != "dis")
+  {
+    const BenchConfig had = {true, nx > 0 ? nx:30, ndata > 0 ? ndata:50, nchannels > 0 ? nchannels:40, sparsity, seed};
+    configs.push_back(had);
+  }
+  if (tables != "had")
+  {
+    const BenchConfig dis = {false, nx > 0 ? nx:50, ndata > 0 ? ndata:500, nchannels > 0 ? nchannels:9, sparsity, seed};
+    configs.push_back(dis);
+  }
+
+  std::vector<BenchResult> results;
+  for (size_t i = 0; i < configs.size(); i++)
+  {
+    const std::string name = configs[i].hadronic ? "hadronic":"dis";
+    const std::string base = dir + "/fkbench_" + name;
+    generateTable(configs[i], "FKBENCH_" + name, base + ".fk");
+#if APFELGRID_HAVE_ZLIB == 1
+    compressTable(base + ".fk", base + ".fk.gz");
+#endif
+
+    benchTable<double>(name, base, npdfs, repeat, results);
+    benchTable<float>(name, base, npdfs, repeat, results);
+
+    remove((base + ".fk").c_str());
+    remove((base + ".fk.gz").c_str());
+  }
+
+  std::ofstream os(output.c_str());
+  writeJSON(os, configs, results, repeat);
+  if (!os.good())
+    throw std::runtime_error("fkbench cannot write output: " + output);
+  std::cout << "fkbench: " << results.size() << " timings written to " << output << std::endl;
+
+  exit(0);
+}
@@ -0,0 +1,66 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016 Nathan Hartland
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// fkconvert: converts plaintext FK tables to the binary, memory-mappable format.
+// The precision of the stored sigma block is double by default, and float with -f.
+// Binary tables are read through the usual FKTable<T>(filename) constructor.
+
+#include "APFELgrid/fastkernel.h"
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <cstdlib>
+
+template<typename T>
+void convert(std::string const& infile, std::string const& outfile)
+{
+  NNPDF::FKTable<T> FK(infile);
+
+  std::ofstream os(outfile.c_str(), std::ios::out | std::ios::binary);
+  if (!os.good())
+    throw std::runtime_error("fkconvert cannot open output file: " + outfile);
+
+  FK.PrintBinary(os);
+  os.close();
+}
+
+int main(int argc, char* argv[])
+{
+  const bool single = (argc == 4 && std::string(argv[1]) == "-f");
+  if (argc != 3 && !single)
+  {
+    std::cerr << "Usage: " << argv[0] << " [-f] <input FK table> <output binary FK table>" << std::endl;
+    std::cerr << "  -f : store sigma in single precision" << std::endl;
+    exit(-1);
+  }
+
+  const std::string infile  = argv[argc-2];
+  const std::string outfile = argv[argc-1];
+
+  if (single)
+    convert<float>(infile, outfile);
+  else
+    convert<double>(infile, outfile);
+
+  exit(0);
+}
@@ -7,6 +7,8 @@
 // For this demonstration, we need some standard headers
 #include <iostream>
 #include <cstdlib>
+#include <cmath>
+#include <limits>
 
 // Along with **LHAPDF** to provide initial scale PDFs
 #include "LHAPDF/LHAPDF.h"
@@ -38,10 +40,25 @@ void fkpdf (const double& x, const double& Q, const size_t& n, ctype* pdf)
   NNPDF::LHA2EVLN<double, ctype>(lha_pdf, pdf);
 }
 
+// Alternatively PDFs may be provided through a batched callback, which fills all *nx* points
+// of the x-grid for the members *n0* to *n0+nmem-1* in a single call. Here the **LHAPDF**
+// values for the whole grid are rotated to the EVLN basis at once.
+void fkpdf_batch (const double* x, int const& nx, double const& Q, size_t const& n0, size_t const& nmem, ctype* pdf)
+{
+  std::vector<double> lha(nx*13);
+  for (size_t m = 0; m < nmem; m++)
+  {
+    for (int i = 0; i < nx; i++)
+      evolvepdf_(x[i], Q, &lha[i*13]);
+    NNPDF::LHA2EVLN(nx, &lha[0], 13, pdf + m*nx*14);
+  }
+}
 
-// With the boilerplate completed, we start the main loop by initialising the *lha_pdf* array
+
+// With the boilerplate completed, we start the main loop by initialising the *lha_pdf* array,
+// with room for a (zero) photon after the 13 **LHAPDF** flavours
 int main(int argc, char* argv[]) {
-	lha_pdf = new double[13];
+	lha_pdf = new double[14]();
 
 	// The **FK** table is then read from file, and a PDF set is initialised
 	std::ifstream infile; infile.open("./tests/atlas-Z0-rapidity.fk");
@@ -60,10 +77,23 @@ int main(int argc, char* argv[]) {
     for (int i=0; i < FK.GetNData(); i++)
 		std::cout << results[i] <<std::endl;
 
+	// The same convolution with the batched callback must reproduce these results, up to rounding
+	ctype* batched = new ctype[FK.GetNData()];
+	FK.Convolute(fkpdf_batch, 1, batched);
+	int status = 0;
+	for (int i=0; i < FK.GetNData(); i++)
+		if (std::fabs(batched[i] - results[i]) > 100*std::numeric_limits<ctype>::epsilon()*std::fabs(results[i]))
+		{
+			std::cerr << "example_conv: batched convolution of datapoint " << i << " differs: "
+			          << batched[i] << " vs " << results[i] << std::endl;
+			status = 1;
+		}
+
 	// Finally we clean up and end the program.
 	delete[] results;
+	delete[] batched;
 	delete[] lha_pdf;
-	exit(0);
+	exit(status);
 }
 
 
@@ -0,0 +1,267 @@
+// APFELgrid
+// =========
+// FastKernel table input and output
+// ---------------------------------
+// This example reads an **FK** table from file and writes it back out, checking both
+// against a plain line-by-line reader and writer, as a test of the **FK** table parser
+// and of the byte-compatibility of the exported format. It also checks the round trip
+// through the binary format, and that split tables are merged back into the original one.
+
+// For this check we need some standard headers
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstdlib>
+#include <clocale>
+#include <cstdio>
+#include <unistd.h>
+
+// Along with the **APFELgrid** FK table header
+#include "APFELgrid/fastkernel.h"
+
+// The reference reader skips the table header, which ends with the *FastKernel* section
+// marker, and then sets the entries of each row in order. For repeated rows the last one
+// in the file is kept. Each hadronic row holds the indices *(d, a, b)* followed by the 196
+// flavour combinations, and each DIS row *(d, a)* followed by 14 flavours.
+template<typename ctype>
+std::vector<ctype> ReadReference(std::string const& filename, NNPDF::FKTable<ctype> const& FK)
+{
+  std::vector<ctype> sigma(size_t(FK.GetDSz())*FK.GetNData(), 0);
+  std::ifstream is(filename.c_str());
+  std::string line;
+  while (getline(is, line))
+    if (line.compare(0, 11, "{FastKernel") == 0)
+      break;
+
+  const int nidx = FK.IsHadronic() ? 3:2;
+  while (getline(is, line))
+  {
+    std::stringstream row(line);
+    std::vector<ctype> values;
+    ctype v;
+    while (row >> v)
+      values.push_back(v);
+    if (values.empty())
+      continue;
+
+    const int d = values[0];
+    const int x = FK.IsHadronic() ? values[1]*FK.GetNx() + values[2]:values[1];
+    for (int i = 0; i < 14; i++)
+      for (int j = 0; j < (FK.IsHadronic() ? 14:1); j++)
+      {
+        const int ch = FK.IsHadronic() ? FK.GetChannel(i, j):FK.GetChannel(i);
+        const int col = FK.IsHadronic() ? 14*i + j:i;
+        if (ch >= 0)
+          sigma[size_t(d)*FK.GetDSz() + ch*FK.GetTx() + x] = values[nidx + col];
+      }
+  }
+  return sigma;
+}
+
+// The reference writer prints the header followed by every row with a nonzero entry.
+// Each entry is followed by a tab, with zero and absent channels printed as *0*
+// and all other values in scientific notation with 16 digits.
+template<typename ctype>
+void WriteReference(NNPDF::FKTable<ctype>& FK, std::ostream& os)
+{
+  FK.NNPDF::FKHeader::Print(os);
+  const ctype* sigma = FK.GetSigma();
+  for (int d = 0; d < FK.GetNData(); d++)
+    for (int x = 0; x < FK.GetTx(); x++)
+    {
+      bool isNonZero = false;
+      std::stringstream outputline;
+      for (int i = 0; i < 14; i++)
+        for (int j = 0; j < (FK.IsHadronic() ? 14:1); j++)
+        {
+          const int ch = FK.IsHadronic() ? FK.GetChannel(i, j):FK.GetChannel(i);
+          const ctype val = ch < 0 ? 0:sigma[size_t(d)*FK.GetDSz() + ch*FK.GetTx() + x];
+          if (val == 0.0)
+            outputline << std::fixed << std::setprecision(0);
+          else
+            outputline << std::scientific << std::setprecision(16);
+          outputline << (ch < 0 ? 0:val) << "\t";
+          if (val != 0) isNonZero = true;
+        }
+
+      if (!isNonZero)
+        continue;
+      os << d << "\t";
+      if (FK.IsHadronic())
+        os << x/FK.GetNx() << "\t" << x%FK.GetNx() << "\t";
+      else
+        os << x << "\t";
+      os << outputline.str() << std::endl;
+    }
+}
+
+// The table is read in the precision *ctype*, and both readers must agree on every entry
+// of the table, including the zero padding.
+template<typename ctype>
+bool CheckRead(std::string const& filename)
+{
+  std::ifstream infile(filename.c_str());
+  NNPDF::FKTable<ctype> FK(infile);
+
+  const std::vector<ctype> ref = ReadReference(filename, FK);
+  if (memcmp(&ref[0], FK.GetSigma(), ref.size()*sizeof(ctype)) != 0)
+  {
+    std::cerr << "example_io: FK table " << filename << " differs from the reference reader" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+// The table is then written in the same precision. It is first exported and read back,
+// so that its flavour map is the one chosen by *FKTable::Print*. The reference writer
+// must then produce the same bytes as *FKTable::Print*.
+template<typename ctype>
+bool CheckPrint(std::string const& filename)
+{
+  std::ifstream infile(filename.c_str());
+  NNPDF::FKTable<ctype> FK(infile);
+
+  std::stringstream exported;
+  FK.Print(exported);
+  NNPDF::FKTable<ctype> FKout(exported);
+
+  std::stringstream out, refout;
+  FKout.Print(out);
+  WriteReference(FKout, refout);
+  if (out.str() != refout.str())
+  {
+    std::cerr << "example_io: FK table " << filename << " is not printed as by the reference writer" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+// The table is also written in the binary format to a temporary file, and read back in the
+// same precision. The header, x-grid, flavour map and sigma block, including the zero padding,
+// must be identical to those of the plaintext table.
+template<typename ctype>
+bool CheckBinary(std::string const& filename)
+{
+  std::ifstream infile(filename.c_str());
+  NNPDF::FKTable<ctype> FK(infile);
+
+  char binname[] = "/tmp/example_io_XXXXXX";
+  const int fd = mkstemp(binname);
+  if (fd == -1)
+  {
+    std::cerr << "example_io: cannot create a temporary file for the binary table" << std::endl;
+    return false;
+  }
+  close(fd);
+  {
+    std::ofstream os(binname, std::ios::binary);
+    FK.PrintBinary(os);
+  }
+  NNPDF::FKTable<ctype> FKbin(binname);
+  remove(binname);
+
+  std::stringstream header, binheader;
+  FK.NNPDF::FKHeader::Print(header);
+  FKbin.NNPDF::FKHeader::Print(binheader);
+  const int nfl = FK.IsHadronic() ? 2*FK.GetNonZero():FK.GetNonZero();
+  const size_t size = size_t(FK.GetDSz())*FK.GetNData();
+  if (header.str() != binheader.str() || FKbin.GetDSz() != FK.GetDSz() ||
+      memcmp(FKbin.GetXGrid(), FK.GetXGrid(), FK.GetNx()*sizeof(double)) != 0 ||
+      memcmp(FKbin.GetFlmap(), FK.GetFlmap(), nfl*sizeof(int)) != 0 ||
+      memcmp(FKbin.GetSigma(), FK.GetSigma(), size*sizeof(ctype)) != 0)
+  {
+    std::cerr << "example_io: FK table " << filename << " differs after the binary round trip" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+// Tables computed in several jobs are recombined with the merge constructor of *FKTable*.
+// The table is split into two halves of its datapoints, which are concatenated, and into two
+// summands each holding alternate entries, which are summed. Both must rebuild the table exactly.
+template<typename ctype>
+bool CheckMerge(std::string const& filename)
+{
+  std::ifstream infile(filename.c_str());
+  NNPDF::FKTable<ctype> FK(infile);
+  const size_t size = size_t(FK.GetDSz())*FK.GetNData();
+
+  std::vector<int> all, lower, upper;
+  for (int d = 0; d < FK.GetNData(); d++)
+  {
+    all.push_back(d);
+    (2*d < FK.GetNData() ? lower:upper).push_back(d);
+  }
+
+  if (!lower.empty() && !upper.empty())
+  {
+    NNPDF::FKTable<ctype> A(FK, lower), B(FK, upper);
+    std::vector<const NNPDF::FKTable<ctype>*> halves;
+    halves.push_back(&A); halves.push_back(&B);
+    NNPDF::FKTable<ctype> merged(halves, NNPDF::FK_CONCATENATE);
+    if (merged.GetNData() != FK.GetNData() || merged.GetDSz() != FK.GetDSz() ||
+        memcmp(merged.GetSigma(), FK.GetSigma(), size*sizeof(ctype)) != 0)
+    {
+      std::cerr << "example_io: FK table " << filename << " is not rebuilt by concatenation" << std::endl;
+      return false;
+    }
+  }
+
+  NNPDF::FKTable<ctype> A(FK, all), B(FK, all);
+  for (size_t i = 0; i < size; i++)
+    (i % 2 ? A:B).GetSigma()[i] = 0;
+  std::vector<const NNPDF::FKTable<ctype>*> summands;
+  summands.push_back(&A); summands.push_back(&B);
+  NNPDF::FKTable<ctype> summed(summands, NNPDF::FK_SUM);
+  if (summed.GetNData() != FK.GetNData() || summed.GetDSz() != FK.GetDSz() ||
+      memcmp(summed.GetSigma(), FK.GetSigma(), size*sizeof(ctype)) != 0)
+  {
+    std::cerr << "example_io: FK table " << filename << " is not rebuilt by summation" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+// FK tables are always read and written with a decimal point, whatever the numeric locale
+// of the host program. A locale with a decimal comma is taken from the environment, or
+// from a few common ones, if any is installed.
+bool SetCommaLocale()
+{
+  const char* candidates[] = {"", "de_DE.UTF-8", "de_DE.utf8", "de_DE", "fr_FR.UTF-8", "fr_FR.utf8", "fr_FR"};
+  for (size_t i = 0; i < sizeof(candidates)/sizeof(candidates[0]); i++)
+    if (setlocale(LC_NUMERIC, candidates[i]) != NULL && strcmp(localeconv()->decimal_point, ".") != 0)
+      return true;
+  setlocale(LC_NUMERIC, "C");
+  return false;
+}
+
+// The table to check is the one produced by *example_gen*, or may be given on the command line.
+// It is checked in both double and single precision, and again under a decimal-comma locale.
+int main(int argc, char* argv[]) {
+  const std::string filename = argc > 1 ? argv[1]:"./tests/atlas-Z0-rapidity.fk";
+
+  if (!CheckRead<double>(filename) || !CheckRead<float>(filename) ||
+      !CheckPrint<double>(filename) || !CheckPrint<float>(filename) ||
+      !CheckBinary<double>(filename) || !CheckBinary<float>(filename) ||
+      !CheckMerge<double>(filename) || !CheckMerge<float>(filename))
+    return 1;
+
+  if (SetCommaLocale())
+  {
+    std::cout << "example_io: checking with LC_NUMERIC " << setlocale(LC_NUMERIC, NULL) << std::endl;
+    if (!CheckRead<double>(filename) || !CheckRead<float>(filename) ||
+        !CheckPrint<double>(filename) || !CheckPrint<float>(filename) ||
+        !CheckBinary<double>(filename) || !CheckBinary<float>(filename))
+      return 1;
+    setlocale(LC_NUMERIC, "C");
+  }
+  else
+    std::cout << "example_io: no decimal-comma locale available, skipping locale check" << std::endl;
+
+  std::cout << "example_io: read and printed " << filename << std::endl;
+  exit(0);
+}